@@ -0,0 +1,120 @@
+/******************************************************************************
+
+ @file  activity.c
+
+ @brief This file contains the fixed-point activity estimator: steps are
+        counted on the smoothed acceleration magnitude with hysteresis,
+        minutes with enough steps are counted as active.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "activity.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Squared thresholds (mg^2), compared against x^2 + y^2 + z^2
+#define STEP_HIGH_MG2     ((uint32_t)ACTIVITY_STEP_HIGH_MG * ACTIVITY_STEP_HIGH_MG)
+#define STEP_LOW_MG2      ((uint32_t)ACTIVITY_STEP_LOW_MG * ACTIVITY_STEP_LOW_MG)
+
+// Magnitudes are clamped to 2 g before smoothing, far over any step, so
+// the filter arithmetic fits in 32 bits
+#define MAG2_CLAMP        ((uint32_t)2000 * 2000)
+
+// Smoothing: one pole low pass, new = old + (in - old) / 2^SMOOTH_SHIFT
+#define SMOOTH_SHIFT      2
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      Activity_init
+ *
+ * @brief   Reset the estimator state and counters.
+ *
+ * @param   pAct - estimator state
+ *
+ * @return  none
+ */
+void Activity_init(activity_t *pAct)
+{
+  pAct->steps         = 0;
+  pAct->activeMinutes = 0;
+  pAct->smoothed      = (uint32_t)1000 * 1000;  // At rest, 1 g
+  pAct->minuteSamples = 0;
+  pAct->minuteSteps   = 0;
+  pAct->sinceStep     = 0xFF;
+  pAct->armed         = false;
+}
+
+/*********************************************************************
+ * @fn      Activity_process
+ *
+ * @brief   Run a batch of samples through the estimator. A few
+ *          multiplications, shifts and compares per sample.
+ *
+ * @param   pAct     - estimator state
+ * @param   pSamples - samples, oldest first
+ * @param   n        - number of samples
+ *
+ * @return  none
+ */
+void Activity_process(activity_t *pAct, const accelSample_t *pSamples,
+                      uint16_t n)
+{
+  uint16_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    uint32_t mag2 = (uint32_t)((int32_t)pSamples[i].x * pSamples[i].x) +
+                    (uint32_t)((int32_t)pSamples[i].y * pSamples[i].y) +
+                    (uint32_t)((int32_t)pSamples[i].z * pSamples[i].z);
+
+    if (mag2 > MAG2_CLAMP)
+    {
+      mag2 = MAG2_CLAMP;
+    }
+
+    pAct->smoothed = (uint32_t)((int32_t)pAct->smoothed +
+                                (((int32_t)mag2 - (int32_t)pAct->smoothed) >> SMOOTH_SHIFT));
+
+    if (pAct->sinceStep < 0xFF)
+    {
+      pAct->sinceStep++;
+    }
+
+    // Step on the rising edge, re-armed on the way down
+    if (pAct->smoothed < STEP_LOW_MG2)
+    {
+      pAct->armed = true;
+    }
+    else if (pAct->armed && (pAct->smoothed > STEP_HIGH_MG2) &&
+             (pAct->sinceStep >= ACTIVITY_STEP_MIN_SAMPLES))
+    {
+      pAct->armed     = false;
+      pAct->sinceStep = 0;
+      pAct->steps++;
+      if (pAct->minuteSteps < 0xFF)
+      {
+        pAct->minuteSteps++;
+      }
+    }
+
+    if (++pAct->minuteSamples >= ACTIVITY_MINUTE_SAMPLES)
+    {
+      if (pAct->minuteSteps >= ACTIVITY_ACTIVE_STEPS)
+      {
+        pAct->activeMinutes++;
+      }
+      pAct->minuteSamples = 0;
+      pAct->minuteSteps   = 0;
+    }
+  }
+}
+/*********************************************************************
+*********************************************************************/
@@ -0,0 +1,93 @@
+/******************************************************************************
+
+ @file  activity.h
+
+ @brief This file contains the fixed-point activity estimator definitions
+        and prototypes (steps and active minutes). As fall_detect, the
+        module only depends on stdint/stdbool so it can be built on the
+        host and fed with recorded accelerometer data.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fall_detect.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Step: smoothed magnitude rising over ACTIVITY_STEP_HIGH_MG after having
+// dropped under ACTIVITY_STEP_LOW_MG, ACTIVITY_STEP_MIN_SAMPLES apart
+#define ACTIVITY_STEP_HIGH_MG        1150
+#define ACTIVITY_STEP_LOW_MG         950
+#define ACTIVITY_STEP_MIN_SAMPLES    10    // 200 ms at 50 Hz, 5 steps/s max
+
+// Active minute: ACTIVITY_ACTIVE_STEPS steps within a minute of samples
+#define ACTIVITY_MINUTE_SAMPLES      (60 * FALL_SAMPLE_RATE_HZ)
+#define ACTIVITY_ACTIVE_STEPS        40
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+// Estimator state, one per sensor
+typedef struct
+{
+  uint32_t steps;          // Steps since power up
+  uint16_t activeMinutes;  // Active minutes since power up
+  uint32_t smoothed;       // Smoothed squared magnitude (mg^2)
+  uint16_t minuteSamples;  // Samples in the current minute
+  uint8_t  minuteSteps;    // Steps in the current minute
+  uint8_t  sinceStep;      // Samples since the last step (saturated)
+  bool     armed;          // Magnitude dropped under the low threshold
+} activity_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Activity_init
+ *
+ * @brief   Reset the estimator state and counters.
+ *
+ * @param   pAct - estimator state
+ *
+ * @return  none
+ */
+void Activity_init(activity_t *pAct);
+
+/*********************************************************************
+ * @fn      Activity_process
+ *
+ * @brief   Run a batch of samples through the estimator.
+ *
+ * @param   pAct     - estimator state
+ * @param   pSamples - samples, oldest first
+ * @param   n        - number of samples
+ *
+ * @return  none
+ */
+void Activity_process(activity_t *pAct, const accelSample_t *pSamples,
+                      uint16_t n);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACTIVITY_H */
@@ -0,0 +1,462 @@
+/******************************************************************************
+
+ @file  board_accel.c
+
+ @brief This file contains the ADXL362 accelerometer interface. Built
+        with the predefined symbol ACCEL_FALL_DETECT only, the board file
+        has to provide Board_SPI0, Board_ACC_CSN, Board_ACC_INT1 and
+        Board_ACC_INT2.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifdef ACCEL_FALL_DETECT
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <ti/sysbios/knl/Clock.h>
+
+#include <ti/drivers/SPI.h>
+#include <ti/drivers/spi/SPICC26XXDMA.h>
+#include <ti/drivers/pin/PINCC26XX.h>
+
+#include <driverlib/cpu.h>
+
+#include "util.h"
+#include "board_accel.h"
+#include "board.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+#if !defined(Board_ACC_CSN) || !defined(Board_ACC_INT1) || !defined(Board_ACC_INT2)
+#error "Board_ACC_CSN, Board_ACC_INT1 and Board_ACC_INT2 must be defined in the board file"
+#endif
+
+// SPI commands
+#define ADXL362_CMD_WRITE         0x0A
+#define ADXL362_CMD_READ          0x0B
+#define ADXL362_CMD_READ_FIFO     0x0D
+
+// Registers
+#define ADXL362_DEVID_AD          0x00  // 0xAD
+#define ADXL362_SOFT_RESET        0x1F  // Write 0x52
+#define ADXL362_THRESH_ACT_L      0x20
+#define ADXL362_THRESH_ACT_H      0x21
+#define ADXL362_TIME_ACT          0x22
+#define ADXL362_THRESH_INACT_L    0x23
+#define ADXL362_THRESH_INACT_H    0x24
+#define ADXL362_TIME_INACT_L      0x25
+#define ADXL362_TIME_INACT_H      0x26
+#define ADXL362_ACT_INACT_CTL     0x27
+#define ADXL362_FIFO_CONTROL      0x28
+#define ADXL362_FIFO_SAMPLES      0x29
+#define ADXL362_INTMAP1           0x2A
+#define ADXL362_INTMAP2           0x2B
+#define ADXL362_FILTER_CTL        0x2C
+#define ADXL362_POWER_CTL         0x2D
+
+// Register values
+#define ADXL362_DEVID             0xAD
+#define ADXL362_RESET_KEY         0x52
+#define ADXL362_FIFO_OFF          0x00  // Disabled, clears the FIFO
+#define ADXL362_FIFO_STREAM       0x02  // Stream mode, no temperature
+#define ADXL362_INT_WATERMARK     0x04  // FIFO watermark on INT1, active high
+#define ADXL362_INT_AWAKE         0x40  // Awake status on INT2, active high
+#define ADXL362_ACT_INACT_OFF     0x00
+#define ADXL362_ACT_INACT_LOOP    0x3F  // Loop mode, referenced activity and inactivity
+#define ADXL362_RANGE_8G_50HZ     0x82  // +-8 g, ODR 50 Hz
+#define ADXL362_MEASURE           0x02  // Measurement mode, normal noise
+#define ADXL362_STANDBY           0x00
+
+// FIFO entries are 16 bit: axis in bits 15:14, sign extended data in 13:0
+#define ACCEL_FIFO_ENTRIES        (3 * ACCEL_BATCH_SAMPLES)
+#define ACCEL_MG_PER_LSB          4     // +-8 g range
+#define ACCEL_ODR_HZ              50
+
+// Motion detection, evaluated by the sensor: referenced thresholds (mg)
+// and activity time (samples)
+#define ACCEL_ACTIVITY_MG         250
+#define ACCEL_INACTIVITY_MG       150
+#define ACCEL_ACTIVITY_SAMPLES    2
+
+// Watermark interrupt deferral (milliseconds), as the key debounce
+#define ACCEL_INT_DEFER           1
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void Board_accelWrite(uint8_t reg, uint8_t value);
+static uint8_t Board_accelRead(uint8_t reg);
+static void Board_accelTransfer(uint16_t count);
+static void Board_accelIntCallback(PIN_Handle hPin, PIN_Id pinId);
+static void Board_accelIntHandler(UArg a0);
+static void Board_accelMotionHandler(UArg a0);
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+// SPI buffers: command (and address) then data, one FIFO batch at most
+static uint8_t accelTxBuf[1 + 2 * ACCEL_FIFO_ENTRIES];
+static uint8_t accelRxBuf[1 + 2 * ACCEL_FIFO_ENTRIES];
+
+static SPI_Handle hAccelSpi = NULL;
+
+// Watermark and awake interrupt clocks
+static Clock_Struct accelIntClock;
+static Clock_Struct accelMotionClock;
+
+// Pointers to application callbacks
+static accelBatchCB_t  appAccelBatchHandler = NULL;
+static accelMotionCB_t appAccelMotionHandler = NULL;
+
+// Chip select (idle high), INT1 (watermark, rising edge, the level is
+// checked again after each drain) and INT2 (awake status, both edges)
+PIN_Config accelPinsCfg[] =
+{
+  Board_ACC_CSN  | PIN_GPIO_OUTPUT_EN | PIN_GPIO_HIGH | PIN_PUSHPULL,
+  Board_ACC_INT1 | PIN_INPUT_EN | PIN_PULLDOWN | PIN_IRQ_POSEDGE,
+  Board_ACC_INT2 | PIN_INPUT_EN | PIN_PULLDOWN | PIN_IRQ_BOTHEDGES,
+  PIN_TERMINATE
+};
+
+PIN_State  accelPins;
+PIN_Handle hAccelPins;
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      Board_initAccel
+ *
+ * @brief   Open the SPI and pins, configure the ADXL362 (+-8 g, 50 Hz,
+ *          FIFO stream mode with watermark on INT1, awake status on
+ *          INT2) and start measuring. Inactivity is disabled until
+ *          Board_accelSetStillTime is called.
+ *
+ * @param   appBatchCB  - application batch ready callback
+ * @param   appMotionCB - application motion change callback
+ *
+ * @return  true if the sensor answered
+ */
+bool Board_initAccel(accelBatchCB_t appBatchCB, accelMotionCB_t appMotionCB)
+{
+  SPI_Params spiParams;
+
+  hAccelPins = PIN_open(&accelPins, accelPinsCfg);
+
+  // Blocking transfers: the calling task pends while the uDMA works
+  SPI_Params_init(&spiParams);
+  spiParams.bitRate      = 4000000;
+  spiParams.frameFormat  = SPI_POL0_PHA0;
+  spiParams.mode         = SPI_MASTER;
+  spiParams.transferMode = SPI_MODE_BLOCKING;
+  hAccelSpi = SPI_open(Board_SPI0, &spiParams);
+
+  if ((hAccelSpi == NULL) || (hAccelPins == NULL))
+  {
+    return false;
+  }
+
+  // Reset, 1 ms settling
+  Board_accelWrite(ADXL362_SOFT_RESET, ADXL362_RESET_KEY);
+  CPUdelay(16000);
+
+  if (Board_accelRead(ADXL362_DEVID_AD) != ADXL362_DEVID)
+  {
+    return false;
+  }
+
+  Board_accelWrite(ADXL362_FILTER_CTL, ADXL362_RANGE_8G_50HZ);
+  Board_accelWrite(ADXL362_FIFO_SAMPLES, ACCEL_FIFO_ENTRIES);
+  Board_accelWrite(ADXL362_FIFO_CONTROL, ADXL362_FIFO_STREAM);
+  Board_accelWrite(ADXL362_INTMAP1, ADXL362_INT_WATERMARK);
+
+  // Motion thresholds, the awake status follows activity and inactivity
+  Board_accelWrite(ADXL362_THRESH_ACT_L, (ACCEL_ACTIVITY_MG / ACCEL_MG_PER_LSB) & 0xFF);
+  Board_accelWrite(ADXL362_THRESH_ACT_H, (ACCEL_ACTIVITY_MG / ACCEL_MG_PER_LSB) >> 8);
+  Board_accelWrite(ADXL362_TIME_ACT, ACCEL_ACTIVITY_SAMPLES);
+  Board_accelWrite(ADXL362_THRESH_INACT_L, (ACCEL_INACTIVITY_MG / ACCEL_MG_PER_LSB) & 0xFF);
+  Board_accelWrite(ADXL362_THRESH_INACT_H, (ACCEL_INACTIVITY_MG / ACCEL_MG_PER_LSB) >> 8);
+  Board_accelWrite(ADXL362_INTMAP2, ADXL362_INT_AWAKE);
+
+  // Watermark and awake interrupts handled out of the Hwi, as the keys
+  Util_constructClock(&accelIntClock, Board_accelIntHandler,
+                      ACCEL_INT_DEFER, 0, false, 0);
+  Util_constructClock(&accelMotionClock, Board_accelMotionHandler,
+                      ACCEL_INT_DEFER, 0, false, 0);
+  appAccelBatchHandler  = appBatchCB;
+  appAccelMotionHandler = appMotionCB;
+  PIN_registerIntCb(hAccelPins, Board_accelIntCallback);
+
+  Board_accelWrite(ADXL362_POWER_CTL, ADXL362_MEASURE);
+
+  return true;
+}
+
+/*********************************************************************
+ * @fn      Board_readAccel
+ *
+ * @brief   Drain one batch from the sensor FIFO. Blocks the calling
+ *          task while the uDMA moves the data. INT1 is edge triggered:
+ *          if the FIFO is still at the watermark afterwards another
+ *          batch is notified, otherwise no new edge would ever come.
+ *
+ * @param   pSamples - ACCEL_BATCH_SAMPLES samples in mg
+ *
+ * @return  number of complete samples
+ */
+uint16_t Board_readAccel(accelSample_t *pSamples)
+{
+  uint16_t i, n = 0;
+  uint8_t  axisSeen = 0;
+
+  if (hAccelSpi == NULL)
+  {
+    return 0;
+  }
+
+  memset(accelTxBuf, 0, sizeof(accelTxBuf));
+  accelTxBuf[0] = ADXL362_CMD_READ_FIFO;
+  Board_accelTransfer(1 + 2 * ACCEL_FIFO_ENTRIES);
+
+  // Samples are rebuilt from the axis tags, a partial leading triplet
+  // (FIFO not aligned yet) is dropped
+  for (i = 0; i < ACCEL_FIFO_ENTRIES; i++)
+  {
+    uint16_t entry = accelRxBuf[1 + 2*i] | ((uint16_t)accelRxBuf[2 + 2*i] << 8);
+    uint8_t  axis  = entry >> 14;
+    int16_t  value = (int16_t)(entry << 2) >> 2;
+
+    value *= ACCEL_MG_PER_LSB;
+
+    switch (axis)
+    {
+      case 0:  pSamples[n].x = value; axisSeen  = 0x01; break;
+      case 1:  pSamples[n].y = value; axisSeen |= 0x02; break;
+      case 2:  pSamples[n].z = value; axisSeen |= 0x04; break;
+      default: break;
+    }
+
+    if (axisSeen == 0x07)
+    {
+      axisSeen = 0;
+      if (++n >= ACCEL_BATCH_SAMPLES)
+      {
+        break;
+      }
+    }
+  }
+
+  // Still at the watermark (drained late): INT1 stays high, no new edge
+  if (PIN_getInputValue(Board_ACC_INT1))
+  {
+    Util_startClock(&accelIntClock);
+  }
+
+  return n;
+}
+
+/*********************************************************************
+ * @fn      Board_accelSetStillTime
+ *
+ * @brief   Set the stillness period after which the sensor reports the
+ *          device as still (awake status low).
+ *
+ * @param   seconds - stillness period, 0 never reports still
+ *
+ * @return  none
+ */
+void Board_accelSetStillTime(uint16_t seconds)
+{
+  uint32_t samples = (uint32_t)seconds * ACCEL_ODR_HZ;
+
+  if (hAccelSpi == NULL)
+  {
+    return;
+  }
+
+  if (samples > 0xFFFF)
+  {
+    samples = 0xFFFF;
+  }
+
+  Board_accelWrite(ADXL362_TIME_INACT_L, samples & 0xFF);
+  Board_accelWrite(ADXL362_TIME_INACT_H, samples >> 8);
+  Board_accelWrite(ADXL362_ACT_INACT_CTL, (seconds > 0)? ADXL362_ACT_INACT_LOOP :
+                                                         ADXL362_ACT_INACT_OFF);
+}
+
+/*********************************************************************
+ * @fn      Board_accelEnableBatches
+ *
+ * @brief   Enable or mask the FIFO watermark interrupt. Batches are
+ *          masked while the device is still so the FIFO does not wake
+ *          the MCU, the FIFO is cleared on enable so the watermark
+ *          raises a fresh edge.
+ *
+ * @param   enable - true to deliver batches
+ *
+ * @return  none
+ */
+void Board_accelEnableBatches(bool enable)
+{
+  if (hAccelSpi == NULL)
+  {
+    return;
+  }
+
+  if (enable)
+  {
+    Board_accelWrite(ADXL362_FIFO_CONTROL, ADXL362_FIFO_OFF);
+    Board_accelWrite(ADXL362_FIFO_CONTROL, ADXL362_FIFO_STREAM);
+    Board_accelWrite(ADXL362_INTMAP1, ADXL362_INT_WATERMARK);
+  }
+  else
+  {
+    Board_accelWrite(ADXL362_INTMAP1, 0);
+  }
+}
+
+/*********************************************************************
+ * @fn      Board_accelStandby
+ *
+ * @brief   Stop measuring (sensor standby), e.g. before a shutdown.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_accelStandby(void)
+{
+  if (hAccelSpi == NULL)
+  {
+    return;
+  }
+
+  Board_accelWrite(ADXL362_POWER_CTL, ADXL362_STANDBY);
+}
+
+/*********************************************************************
+ * @fn      Board_accelWrite
+ *
+ * @brief   Write a sensor register.
+ *
+ * @param   reg   - register address
+ * @param   value - register value
+ *
+ * @return  none
+ */
+static void Board_accelWrite(uint8_t reg, uint8_t value)
+{
+  accelTxBuf[0] = ADXL362_CMD_WRITE;
+  accelTxBuf[1] = reg;
+  accelTxBuf[2] = value;
+  Board_accelTransfer(3);
+}
+
+/*********************************************************************
+ * @fn      Board_accelRead
+ *
+ * @brief   Read a sensor register.
+ *
+ * @param   reg - register address
+ *
+ * @return  register value
+ */
+static uint8_t Board_accelRead(uint8_t reg)
+{
+  accelTxBuf[0] = ADXL362_CMD_READ;
+  accelTxBuf[1] = reg;
+  accelTxBuf[2] = 0;
+  Board_accelTransfer(3);
+
+  return accelRxBuf[2];
+}
+
+/*********************************************************************
+ * @fn      Board_accelTransfer
+ *
+ * @brief   SPI transaction framed by the chip select.
+ *
+ * @param   count - bytes to transfer
+ *
+ * @return  none
+ */
+static void Board_accelTransfer(uint16_t count)
+{
+  SPI_Transaction transaction;
+
+  transaction.count = count;
+  transaction.txBuf = accelTxBuf;
+  transaction.rxBuf = accelRxBuf;
+
+  PIN_setOutputValue(hAccelPins, Board_ACC_CSN, 0);
+  SPI_transfer(hAccelSpi, &transaction);
+  PIN_setOutputValue(hAccelPins, Board_ACC_CSN, 1);
+}
+
+/*********************************************************************
+ * @fn      Board_accelIntCallback
+ *
+ * @brief   Interrupt handler for the FIFO watermark and awake status
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void Board_accelIntCallback(PIN_Handle hPin, PIN_Id pinId)
+{
+  if (pinId == Board_ACC_INT2)
+  {
+    Util_startClock(&accelMotionClock);
+  }
+  else
+  {
+    Util_startClock(&accelIntClock);
+  }
+}
+
+/*********************************************************************
+ * @fn      Board_accelIntHandler
+ *
+ * @brief   Handler for the FIFO watermark
+ *
+ * @param   UArg a0 - ignored
+ *
+ * @return  none
+ */
+static void Board_accelIntHandler(UArg a0)
+{
+  if (appAccelBatchHandler != NULL)
+  {
+    // Notify the application
+    (*appAccelBatchHandler)();
+  }
+}
+
+/*********************************************************************
+ * @fn      Board_accelMotionHandler
+ *
+ * @brief   Handler for the awake status
+ *
+ * @param   UArg a0 - ignored
+ *
+ * @return  none
+ */
+static void Board_accelMotionHandler(UArg a0)
+{
+  if (appAccelMotionHandler != NULL)
+  {
+    // Notify the application with the settled level
+    (*appAccelMotionHandler)(PIN_getInputValue(Board_ACC_INT2) != 0);
+  }
+}
+
+#endif // ACCEL_FALL_DETECT
+/*********************************************************************
+*********************************************************************/
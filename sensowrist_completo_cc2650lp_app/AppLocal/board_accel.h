@@ -0,0 +1,117 @@
+/******************************************************************************
+
+ @file  board_accel.h
+
+ @brief This file contains the ADXL362 accelerometer definitions and
+        prototypes. Samples are buffered in the sensor FIFO and drained
+        in batches over SPI (uDMA) on the FIFO watermark interrupt. The
+        sensor also tracks motion itself and reports still / moving
+        changes on its second interrupt line.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef BOARD_ACCEL_H
+#define BOARD_ACCEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "fall_detect.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Samples (x, y, z triplets) per FIFO batch, 0.5 s at 50 Hz
+#define ACCEL_BATCH_SAMPLES   25
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+// Called (SWI context) when a batch is ready in the sensor FIFO
+typedef void (*accelBatchCB_t)(void);
+
+// Called (SWI context) when the device starts moving or has been still
+// for the configured period
+typedef void (*accelMotionCB_t)(bool moving);
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Board_initAccel
+ *
+ * @brief   Open the SPI and pins, configure the ADXL362 (+-8 g, 50 Hz,
+ *          FIFO stream mode with watermark on INT1, awake status on
+ *          INT2) and start measuring. Inactivity is disabled until
+ *          Board_accelSetStillTime is called.
+ *
+ * @param   appBatchCB  - application batch ready callback
+ * @param   appMotionCB - application motion change callback
+ *
+ * @return  true if the sensor answered
+ */
+bool Board_initAccel(accelBatchCB_t appBatchCB, accelMotionCB_t appMotionCB);
+
+/*********************************************************************
+ * @fn      Board_readAccel
+ *
+ * @brief   Drain one batch from the sensor FIFO. Blocks the calling
+ *          task while the uDMA moves the data. INT1 is edge triggered:
+ *          if the FIFO is still at the watermark afterwards another
+ *          batch is notified, otherwise no new edge would ever come.
+ *
+ * @param   pSamples - ACCEL_BATCH_SAMPLES samples in mg
+ *
+ * @return  number of complete samples
+ */
+uint16_t Board_readAccel(accelSample_t *pSamples);
+
+/*********************************************************************
+ * @fn      Board_accelSetStillTime
+ *
+ * @brief   Set the stillness period after which the sensor reports the
+ *          device as still (awake status low).
+ *
+ * @param   seconds - stillness period, 0 never reports still
+ *
+ * @return  none
+ */
+void Board_accelSetStillTime(uint16_t seconds);
+
+/*********************************************************************
+ * @fn      Board_accelEnableBatches
+ *
+ * @brief   Enable or mask the FIFO watermark interrupt.
+ *
+ * @param   enable - true to deliver batches
+ *
+ * @return  none
+ */
+void Board_accelEnableBatches(bool enable);
+
+/*********************************************************************
+ * @fn      Board_accelStandby
+ *
+ * @brief   Stop measuring (sensor standby), e.g. before a shutdown.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_accelStandby(void);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOARD_ACCEL_H */
@@ -54,6 +54,10 @@
 #include <ti/sysbios/knl/Queue.h>
 
 #include <ti/drivers/pin/PINCC26XX.h>
+#ifdef POWER_SAVING
+#include <ti/drivers/Power.h>
+#include <ti/drivers/power/PowerCC26XX.h>
+#endif //POWER_SAVING
 
 #ifdef USE_ICALL
 #include <icall.h>
@@ -139,6 +143,32 @@ void Board_initKeys(keysPressedCB_t appKeyCB)
   appKeyChangeHandler = appKeyCB;
 }
 
+#ifdef POWER_SAVING
+/*********************************************************************
+ * @fn      Board_keyShutdown
+ *
+ * @brief   Enter shutdown with KEY_1 as the only wakeup source. Does
+ *          not return on success, a key press resets the device.
+ *
+ * @param   none
+ *
+ * @return  Power_shutdown status when the shutdown was refused (e.g. a
+ *          constraint still set by a driver)
+ */
+int_fast16_t Board_keyShutdown(void)
+{
+  PIN_Config wakeupPinsCfg[] =
+  {
+    Board_KEY_1 | PIN_INPUT_EN | PIN_PULLUP | PINCC26XX_WAKEUP_NEGEDGE,
+    PIN_TERMINATE
+  };
+
+  PINCC26XX_setWakeup(wakeupPinsCfg);
+
+  return Power_shutdown(0, 0);
+}
+#endif //POWER_SAVING
+
 /*********************************************************************
  * @fn      Board_keyCallback
  *
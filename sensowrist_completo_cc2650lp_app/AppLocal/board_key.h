@@ -92,6 +92,21 @@ typedef void (*keysPressedCB_t)(uint8_t keysPressed);
  */
 void Board_initKeys(keysPressedCB_t appKeyCB);
 
+#ifdef POWER_SAVING
+/*********************************************************************
+ * @fn      Board_keyShutdown
+ *
+ * @brief   Enter shutdown with KEY_1 as the only wakeup source. Does
+ *          not return on success, a key press resets the device.
+ *
+ * @param   none
+ *
+ * @return  Power_shutdown status when the shutdown was refused (e.g. a
+ *          constraint still set by a driver)
+ */
+int_fast16_t Board_keyShutdown(void);
+#endif //POWER_SAVING
+
 /*********************************************************************
 *********************************************************************/  
 
@@ -0,0 +1,304 @@
+/******************************************************************************
+
+ @file  board_led.c
+
+ @brief This file contains the led pattern player.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdbool.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Swi.h>
+
+#include <ti/drivers/pin/PINCC26XX.h>
+
+#include "util.h"
+#include "board_led.h"
+#include "board.h"
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void Board_ledStepHandler(UArg a0);
+static void Board_ledApplyStep(void);
+static void Board_ledNextStep(void);
+static void Board_ledSet(uint8_t level);
+static void Board_ledAccount(void);
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+// Pattern table and on time counters
+static const ledPattern_t *ledPatterns = NULL;
+static uint8_t  ledNumPatterns = 0;
+static uint32_t *ledOnTime = NULL;
+
+// Player state
+static uint8_t  ledPattern = LED_PATTERN_NONE;
+static uint8_t  ledStep = 0;
+static bool     ledWaitAdv = false;
+static bool     ledOn = false;
+static uint32_t ledOnSince = 0;
+
+// Step clock
+static Clock_Struct ledStepClock;
+
+#ifdef POWER_MEASURE
+// Step clock expirations
+static uint32_t ledWakeups = 0;
+#endif
+
+// Led pin, initially off
+PIN_Config ledCtrlCfg[] =
+{
+  Board_LED1 | PIN_GPIO_OUTPUT_EN | PIN_GPIO_LOW | PIN_PUSHPULL | PIN_DRVSTR_MAX,
+  PIN_TERMINATE
+};
+
+PIN_State  ledCtrlState;
+PIN_Handle ledCtrlHandle;
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      Board_initLed
+ *
+ * @brief   Open the led pin and register the pattern table.
+ *
+ * @param   pPatterns   - pattern table, indexed by pattern id
+ * @param   numPatterns - patterns in the table
+ * @param   pOnTime     - per pattern led on time counters (ms), may be NULL
+ *
+ * @return  none
+ */
+void Board_initLed(const ledPattern_t *pPatterns, uint8_t numPatterns,
+                   uint32_t *pOnTime)
+{
+  ledCtrlHandle = PIN_open(&ledCtrlState, ledCtrlCfg);
+
+  Util_constructClock(&ledStepClock, Board_ledStepHandler, 0, 0, false, 0);
+
+  ledPatterns    = pPatterns;
+  ledNumPatterns = numPatterns;
+  ledOnTime      = pOnTime;
+}
+
+/*********************************************************************
+ * @fn      Board_ledPlay
+ *
+ * @brief   Play a pattern from its first step, replacing the current one.
+ *
+ * @param   pattern - pattern id
+ *
+ * @return  none
+ */
+void Board_ledPlay(uint8_t pattern)
+{
+  UInt key;
+
+  if (pattern >= ledNumPatterns)
+  {
+    return;
+  }
+
+  key = Swi_disable();
+
+  // On time so far belongs to the pattern being replaced
+  Board_ledAccount();
+
+  ledPattern = pattern;
+  ledStep    = 0;
+  Board_ledApplyStep();
+
+  Swi_restore(key);
+}
+
+/*********************************************************************
+ * @fn      Board_ledStop
+ *
+ * @brief   Stop the current pattern and switch the led off.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_ledStop(void)
+{
+  UInt key = Swi_disable();
+
+  Util_stopClock(&ledStepClock);
+  Board_ledSet(0);
+
+  ledPattern = LED_PATTERN_NONE;
+  ledWaitAdv = false;
+
+  Swi_restore(key);
+}
+
+/*********************************************************************
+ * @fn      Board_ledAdvEvent
+ *
+ * @brief   Advertising event notice, advances a step waiting on it.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_ledAdvEvent(void)
+{
+  UInt key = Swi_disable();
+
+  if (ledWaitAdv)
+  {
+    Board_ledNextStep();
+  }
+
+  Swi_restore(key);
+}
+
+#ifdef POWER_MEASURE
+/*********************************************************************
+ * @fn      Board_ledWakeups
+ *
+ * @brief   Step clock expirations since power up (wakeup attribution).
+ *
+ * @param   none
+ *
+ * @return  number of step clock wakeups
+ */
+uint32_t Board_ledWakeups(void)
+{
+  return ledWakeups;
+}
+#endif
+
+/*********************************************************************
+ * @fn      Board_ledStepHandler
+ *
+ * @brief   Step clock expired.
+ *
+ * @param   UArg a0 - ignored
+ *
+ * @return  none
+ */
+static void Board_ledStepHandler(UArg a0)
+{
+#ifdef POWER_MEASURE
+  ledWakeups++;
+#endif
+
+  if (ledPattern != LED_PATTERN_NONE)
+  {
+    Board_ledNextStep();
+  }
+}
+
+/*********************************************************************
+ * @fn      Board_ledApplyStep
+ *
+ * @brief   Set the led level of the current step and wait its duration.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void Board_ledApplyStep(void)
+{
+  uint16_t step     = ledPatterns[ledPattern].pSteps[ledStep];
+  uint16_t duration = step & 0x7FFF;
+
+  Board_ledSet(step >> 15);
+
+  ledWaitAdv = (duration == LED_UNTIL_ADV);
+
+  if ((duration == LED_HOLD) || ledWaitAdv)
+  {
+    Util_stopClock(&ledStepClock);
+  }
+  else
+  {
+    Util_restartClock(&ledStepClock, duration);
+  }
+}
+
+/*********************************************************************
+ * @fn      Board_ledNextStep
+ *
+ * @brief   Advance to the next step, stop at the end of a single shot
+ *          pattern.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void Board_ledNextStep(void)
+{
+  if (++ledStep >= ledPatterns[ledPattern].numSteps)
+  {
+    if (!ledPatterns[ledPattern].loop)
+    {
+      Board_ledSet(0);
+      ledPattern = LED_PATTERN_NONE;
+      ledWaitAdv = false;
+      return;
+    }
+
+    ledStep = 0;
+  }
+
+  Board_ledApplyStep();
+}
+
+/*********************************************************************
+ * @fn      Board_ledSet
+ *
+ * @brief   Drive the led, accounting the on time to the current pattern.
+ *
+ * @param   level - 1 on, 0 off
+ *
+ * @return  none
+ */
+static void Board_ledSet(uint8_t level)
+{
+  if (level && !ledOn)
+  {
+    ledOnSince = Clock_getTicks();
+  }
+  else if (!level && ledOn)
+  {
+    Board_ledAccount();
+  }
+
+  ledOn = level;
+  PIN_setOutputValue(ledCtrlHandle, Board_LED1, level ? Board_LED_ON : Board_LED_OFF);
+}
+
+/*********************************************************************
+ * @fn      Board_ledAccount
+ *
+ * @brief   Add the on time since the last accounting to the current
+ *          pattern counter.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void Board_ledAccount(void)
+{
+  uint32_t now = Clock_getTicks();
+
+  if (ledOn && ledOnTime && (ledPattern != LED_PATTERN_NONE))
+  {
+    ledOnTime[ledPattern] += (now - ledOnSince) / (1000 / Clock_tickPeriod);
+  }
+
+  ledOnSince = now;
+}
+/*********************************************************************
+*********************************************************************/
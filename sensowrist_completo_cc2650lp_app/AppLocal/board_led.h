@@ -0,0 +1,124 @@
+/******************************************************************************
+
+ @file  board_led.h
+
+ @brief This file contains the led pattern player definitions and
+        prototypes. Patterns are constant step tables kept in flash,
+        played with a single clock and, for steps waiting on it, stepped
+        from the advertising event so no extra wakeup is scheduled.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef BOARD_LED_H
+#define BOARD_LED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Step durations with a special meaning
+#define LED_HOLD              0x0000  // Keep the level until stopped or replaced
+#define LED_UNTIL_ADV         0x7FFF  // Keep the level until the next advertising event
+
+// No pattern playing
+#define LED_PATTERN_NONE      0xFF
+
+/*********************************************************************
+ * MACROS
+ */
+// Pattern steps: led level in bit 15, duration in milliseconds (max 32766)
+#define LED_ON(ms)            (0x8000 | (ms))
+#define LED_OFF(ms)           (ms)
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+// Led pattern, declared const so the step table stays in flash
+typedef struct
+{
+  const uint16_t *pSteps;   // Step table (LED_ON/LED_OFF)
+  uint8_t         numSteps; // Steps in the table
+  uint8_t         loop;     // Restart from the first step when done
+} ledPattern_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Board_initLed
+ *
+ * @brief   Open the led pin and register the pattern table.
+ *
+ * @param   pPatterns   - pattern table, indexed by pattern id
+ * @param   numPatterns - patterns in the table
+ * @param   pOnTime     - per pattern led on time counters (ms), may be NULL
+ *
+ * @return  none
+ */
+void Board_initLed(const ledPattern_t *pPatterns, uint8_t numPatterns,
+                   uint32_t *pOnTime);
+
+/*********************************************************************
+ * @fn      Board_ledPlay
+ *
+ * @brief   Play a pattern from its first step, replacing the current one.
+ *
+ * @param   pattern - pattern id
+ *
+ * @return  none
+ */
+void Board_ledPlay(uint8_t pattern);
+
+/*********************************************************************
+ * @fn      Board_ledStop
+ *
+ * @brief   Stop the current pattern and switch the led off.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_ledStop(void);
+
+/*********************************************************************
+ * @fn      Board_ledAdvEvent
+ *
+ * @brief   Advertising event notice, advances a step waiting on it.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void Board_ledAdvEvent(void);
+
+#ifdef POWER_MEASURE
+/*********************************************************************
+ * @fn      Board_ledWakeups
+ *
+ * @brief   Step clock expirations since power up (wakeup attribution).
+ *
+ * @param   none
+ *
+ * @return  number of step clock wakeups
+ */
+uint32_t Board_ledWakeups(void);
+#endif
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOARD_LED_H */
@@ -0,0 +1,226 @@
+/******************************************************************************
+
+ @file  event_log.c
+
+ @brief This file contains the tokenized event log: binary records kept
+        in a RAM ring, no string formatting on the device.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifdef EVENT_LOG
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <driverlib/aon_rtc.h>
+
+#include "event_log.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Record header: token, number of arguments, time base
+#define LOG_HDR_LEN       4
+
+// Longest record, 5 bytes per LEB128 argument
+#define LOG_REC_MAX_LEN   (LOG_HDR_LEN + 5*EVENT_LOG_MAX_ARGS)
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+static uint8_t  logRing[EVENT_LOG_SIZE];
+static uint16_t logHead = 0;     // Oldest record
+static uint16_t logUsed = 0;     // Bytes in use
+static uint16_t logDropped = 0;  // Records dropped since the last ack
+
+// Handed out by the last peek, dropped on ack
+static uint16_t logPeekLen = 0;      // Ring bytes from logHead
+static uint16_t logPeekDropped = 0;  // Loss count in the LOG_DROPPED record
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      encodeArg
+ *
+ * @brief   Unsigned LEB128: 7 bits per byte, low first, bit 7 set on
+ *          all but the last byte.
+ *
+ * @param   pDst  - destination (5 bytes max)
+ * @param   value - argument
+ *
+ * @return  bytes written
+ */
+static uint8_t encodeArg(uint8_t *pDst, uint32_t value)
+{
+  uint8_t len = 0;
+
+  while (value >= 0x80)
+  {
+    pDst[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  pDst[len++] = (uint8_t)value;
+
+  return len;
+}
+
+/*********************************************************************
+ * @fn      recordLen
+ *
+ * @brief   Length of a record in the ring.
+ *
+ * @param   start - ring index of the record
+ *
+ * @return  record length in bytes
+ */
+static uint16_t recordLen(uint16_t start)
+{
+  uint8_t  nArgs = logRing[(start + 1) % EVENT_LOG_SIZE];
+  uint16_t len = LOG_HDR_LEN;
+
+  while (nArgs--)
+  {
+    while (logRing[(start + len++) % EVENT_LOG_SIZE] & 0x80);
+  }
+
+  return len;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      EventLog_write
+ *
+ * @brief   Append a record (application task only). Layout:
+ *            0     token
+ *            1     number of arguments
+ *            2-3   time base (1/8 s, wraps, little endian)
+ *            4-    arguments, unsigned LEB128 (1 to 5 bytes each)
+ *
+ * @param   token - LOG_xxx token
+ * @param   nArgs - arguments in use (max EVENT_LOG_MAX_ARGS)
+ * @param   a0    - first argument
+ * @param   a1    - second argument
+ * @param   a2    - third argument
+ *
+ * @return  none
+ */
+void EventLog_write(uint8_t token, uint8_t nArgs,
+                    uint32_t a0, uint32_t a1, uint32_t a2)
+{
+  uint8_t  rec[LOG_REC_MAX_LEN];
+  uint16_t time = (uint16_t)(AONRTCCurrentCompareValueGet() >> 13);
+  uint16_t len = LOG_HDR_LEN;
+  uint16_t i;
+
+  rec[0] = token;
+  rec[1] = nArgs;
+  rec[2] = (uint8_t)time;
+  rec[3] = (uint8_t)(time >> 8);
+
+  if (nArgs > 0) len += encodeArg(&rec[len], a0);
+  if (nArgs > 1) len += encodeArg(&rec[len], a1);
+  if (nArgs > 2) len += encodeArg(&rec[len], a2);
+
+  // Keep the latest records. A peeked record dropped before its ack is
+  // counted as lost too, the read may never be confirmed.
+  while (logUsed + len > EVENT_LOG_SIZE)
+  {
+    uint16_t oldLen = recordLen(logHead);
+
+    logHead = (logHead + oldLen) % EVENT_LOG_SIZE;
+    logUsed -= oldLen;
+    logDropped++;
+
+    if (logPeekLen > 0)
+    {
+      logPeekLen -= oldLen;
+    }
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    logRing[(logHead + logUsed + i) % EVENT_LOG_SIZE] = rec[i];
+  }
+  logUsed += len;
+}
+
+/*********************************************************************
+ * @fn      EventLog_peek
+ *
+ * @brief   Copy whole records, oldest first, without consuming them. A
+ *          LOG_DROPPED record leads when records were lost. The records
+ *          stay in the ring until EventLog_ack.
+ *
+ * @param   pBuf   - destination
+ * @param   maxLen - destination size
+ *
+ * @return  bytes written to pBuf
+ */
+uint16_t EventLog_peek(uint8_t *pBuf, uint16_t maxLen)
+{
+  uint16_t len = 0;
+
+  logPeekLen = 0;
+  logPeekDropped = 0;
+
+  if ((logDropped > 0) && (maxLen >= LOG_HDR_LEN + 3))
+  {
+    uint16_t time = (uint16_t)(AONRTCCurrentCompareValueGet() >> 13);
+
+    pBuf[0] = LOG_DROPPED;
+    pBuf[1] = 1;
+    pBuf[2] = (uint8_t)time;
+    pBuf[3] = (uint8_t)(time >> 8);
+    len = LOG_HDR_LEN + encodeArg(&pBuf[LOG_HDR_LEN], logDropped);
+    logPeekDropped = logDropped;
+  }
+
+  while (logPeekLen < logUsed)
+  {
+    uint16_t start = (logHead + logPeekLen) % EVENT_LOG_SIZE;
+    uint16_t recLen = recordLen(start);
+    uint16_t i;
+
+    if (len + recLen > maxLen)
+    {
+      break;
+    }
+
+    for (i = 0; i < recLen; i++)
+    {
+      pBuf[len++] = logRing[(start + i) % EVENT_LOG_SIZE];
+    }
+    logPeekLen += recLen;
+  }
+
+  return len;
+}
+
+/*********************************************************************
+ * @fn      EventLog_ack
+ *
+ * @brief   Drop the records (and the loss count) handed out by the last
+ *          EventLog_peek, once the reader confirmed them.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void EventLog_ack(void)
+{
+  logHead = (logHead + logPeekLen) % EVENT_LOG_SIZE;
+  logUsed -= logPeekLen;
+  logDropped -= logPeekDropped;
+
+  logPeekLen = 0;
+  logPeekDropped = 0;
+}
+
+#endif // EVENT_LOG
+/*********************************************************************
+*********************************************************************/
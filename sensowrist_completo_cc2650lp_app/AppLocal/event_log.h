@@ -0,0 +1,136 @@
+/******************************************************************************
+
+ @file  event_log.h
+
+ @brief This file contains the tokenized event log definitions and
+        prototypes. Only a token, a time stamp and the raw arguments are
+        stored in a RAM ring, the format strings below never reach the
+        image: the host decoder reads them from this header.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Ring size in bytes, the oldest records are dropped when full
+#define EVENT_LOG_SIZE        128
+
+// Arguments per record
+#define EVENT_LOG_MAX_ARGS    3
+
+// Token dictionary, X(token, format). Append only: the token value is
+// the position in the list and old captures must keep decoding.
+// Arguments are unsigned 32 bit values.
+#define EVENT_LOG_TOKENS \
+  X(LOG_DROPPED,        "%u records dropped")                   \
+  X(LOG_BOOT,           "BLE Broadcaster fw 0x%02x reset %u")   \
+  X(LOG_ACCEL_MISSING,  "Accel not found")                      \
+  X(LOG_INITIALIZED,    "Initialized %04x%08x")                 \
+  X(LOG_ADVERTISING,    "Advertising")                          \
+  X(LOG_WAITING,        "Waiting")                              \
+  X(LOG_CONNECTED,      "Connected")                            \
+  X(LOG_GAP_ERROR,      "Error")                                \
+  X(LOG_CHECK_FAILED,   "Check failed: %u")                     \
+  X(LOG_ALARM,          "Alarm raised, state %u")               \
+  X(LOG_SHUTDOWN_FAILED, "Shutdown refused, Power error -%u")
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+#define X(token, format) token,
+typedef enum
+{
+  EVENT_LOG_TOKENS
+  LOG_TOKEN_COUNT
+} logToken_t;
+#undef X
+
+/*********************************************************************
+ * MACROS
+ */
+// Log calls (predefined symbol EVENT_LOG), compiled out otherwise with
+// their arguments
+#ifdef EVENT_LOG
+#define LOG_EVENT0(t)           EventLog_write((t), 0, 0, 0, 0)
+#define LOG_EVENT1(t, a)        EventLog_write((t), 1, (a), 0, 0)
+#define LOG_EVENT2(t, a, b)     EventLog_write((t), 2, (a), (b), 0)
+#define LOG_EVENT3(t, a, b, c)  EventLog_write((t), 3, (a), (b), (c))
+#else
+#define LOG_EVENT0(t)
+#define LOG_EVENT1(t, a)
+#define LOG_EVENT2(t, a, b)
+#define LOG_EVENT3(t, a, b, c)
+#endif
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      EventLog_write
+ *
+ * @brief   Append a record (application task only). Layout:
+ *            0     token
+ *            1     number of arguments
+ *            2-3   time base (1/8 s, wraps, little endian)
+ *            4-    arguments, unsigned LEB128 (1 to 5 bytes each)
+ *
+ * @param   token - LOG_xxx token
+ * @param   nArgs - arguments in use (max EVENT_LOG_MAX_ARGS)
+ * @param   a0    - first argument
+ * @param   a1    - second argument
+ * @param   a2    - third argument
+ *
+ * @return  none
+ */
+void EventLog_write(uint8_t token, uint8_t nArgs,
+                    uint32_t a0, uint32_t a1, uint32_t a2);
+
+/*********************************************************************
+ * @fn      EventLog_peek
+ *
+ * @brief   Copy whole records, oldest first, without consuming them. A
+ *          LOG_DROPPED record leads when records were lost. The records
+ *          stay in the ring until EventLog_ack.
+ *
+ * @param   pBuf   - destination
+ * @param   maxLen - destination size
+ *
+ * @return  bytes written to pBuf
+ */
+uint16_t EventLog_peek(uint8_t *pBuf, uint16_t maxLen);
+
+/*********************************************************************
+ * @fn      EventLog_ack
+ *
+ * @brief   Drop the records (and the loss count) handed out by the last
+ *          EventLog_peek, once the reader confirmed them.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void EventLog_ack(void);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOG_H */
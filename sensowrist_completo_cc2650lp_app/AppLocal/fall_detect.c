@@ -0,0 +1,100 @@
+/******************************************************************************
+
+ @file  fall_detect.c
+
+ @brief This file contains the fixed-point fall detection: a free fall
+        phase followed by an impact within a short window.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "fall_detect.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Squared thresholds (mg^2), compared against x^2 + y^2 + z^2
+#define FREEFALL_MG2   ((uint32_t)FALL_FREEFALL_MG * FALL_FREEFALL_MG)
+#define IMPACT_MG2     ((uint32_t)FALL_IMPACT_MG * FALL_IMPACT_MG)
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+/*********************************************************************
+ * @fn      FallDetect_init
+ *
+ * @brief   Reset the detector state.
+ *
+ * @param   pFd - detector state
+ *
+ * @return  none
+ */
+void FallDetect_init(fallDetect_t *pFd)
+{
+  pFd->freeFallRun  = 0;
+  pFd->impactWindow = 0;
+}
+
+/*********************************************************************
+ * @fn      FallDetect_process
+ *
+ * @brief   Run a batch of samples through the detector. Squared
+ *          magnitudes are compared, no square root nor division.
+ *
+ * @param   pFd      - detector state
+ * @param   pSamples - samples, oldest first
+ * @param   n        - number of samples
+ *
+ * @return  true if a fall was detected in this batch
+ */
+bool FallDetect_process(fallDetect_t *pFd, const accelSample_t *pSamples,
+                        uint16_t n)
+{
+  bool fall = false;
+  uint16_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    // Max 3 * 16000^2 for a +-16 g sensor, fits in 32 bits
+    uint32_t mag2 = (uint32_t)((int32_t)pSamples[i].x * pSamples[i].x) +
+                    (uint32_t)((int32_t)pSamples[i].y * pSamples[i].y) +
+                    (uint32_t)((int32_t)pSamples[i].z * pSamples[i].z);
+
+    if (mag2 < FREEFALL_MG2)
+    {
+      // Free fall going on, the impact window opens when it ends
+      if (pFd->freeFallRun < 0xFF)
+      {
+        pFd->freeFallRun++;
+      }
+      continue;
+    }
+
+    if (pFd->freeFallRun >= FALL_FREEFALL_SAMPLES)
+    {
+      pFd->impactWindow = FALL_IMPACT_SAMPLES;
+    }
+    pFd->freeFallRun = 0;
+
+    if (pFd->impactWindow > 0)
+    {
+      if (mag2 > IMPACT_MG2)
+      {
+        pFd->impactWindow = 0;
+        fall = true;
+      }
+      else
+      {
+        pFd->impactWindow--;
+      }
+    }
+  }
+
+  return fall;
+}
+/*********************************************************************
+*********************************************************************/
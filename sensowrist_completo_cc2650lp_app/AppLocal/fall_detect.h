@@ -0,0 +1,96 @@
+/******************************************************************************
+
+ @file  fall_detect.h
+
+ @brief This file contains the fixed-point fall detection definitions and
+        prototypes. The module only depends on stdint/stdbool so it can
+        be built on the host and fed with recorded accelerometer data.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef FALL_DETECT_H
+#define FALL_DETECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Sample rate the thresholds below are tuned for
+#define FALL_SAMPLE_RATE_HZ        50
+
+// Free fall: magnitude under FALL_FREEFALL_MG for FALL_FREEFALL_SAMPLES
+#define FALL_FREEFALL_MG           400
+#define FALL_FREEFALL_SAMPLES      5    // 100 ms
+
+// Impact: magnitude over FALL_IMPACT_MG within FALL_IMPACT_SAMPLES after
+// the free fall ended
+#define FALL_IMPACT_MG             2500
+#define FALL_IMPACT_SAMPLES        25   // 500 ms
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+// Acceleration sample in mg
+typedef struct
+{
+  int16_t x;
+  int16_t y;
+  int16_t z;
+} accelSample_t;
+
+// Detector state, one per sensor
+typedef struct
+{
+  uint8_t freeFallRun;   // Consecutive free fall samples
+  uint8_t impactWindow;  // Samples left to see the impact, 0 when idle
+} fallDetect_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      FallDetect_init
+ *
+ * @brief   Reset the detector state.
+ *
+ * @param   pFd - detector state
+ *
+ * @return  none
+ */
+void FallDetect_init(fallDetect_t *pFd);
+
+/*********************************************************************
+ * @fn      FallDetect_process
+ *
+ * @brief   Run a batch of samples through the detector. Squared
+ *          magnitudes are compared, no square root nor division.
+ *
+ * @param   pFd      - detector state
+ * @param   pSamples - samples, oldest first
+ * @param   n        - number of samples
+ *
+ * @return  true if a fall was detected in this batch
+ */
+bool FallDetect_process(fallDetect_t *pFd, const accelSample_t *pSamples,
+                        uint16_t n);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FALL_DETECT_H */
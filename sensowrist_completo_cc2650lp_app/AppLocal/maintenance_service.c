@@ -0,0 +1,435 @@
+/******************************************************************************
+
+ @file  maintenance_service.c
+
+ @brief This file contains the smartcare-beacon maintenance GATT service:
+        a bulk telemetry characteristic (read, long read), a batched
+        configuration characteristic (read, write, long write) taking the
+        same signed frames as the command beacons and, with
+        EVENT_LOG, the event log records (read, long read).
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+
+#include "bcomdef.h"
+#include "linkdb.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gattservapp.h"
+
+#include "maintenance_service.h"
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// 128 bit UUID base for the smartcare-beacon services
+#define MAINT_BASE_UUID_128(uuid)  0x53, 0x4D, 0x43, 0x41, 0x52, 0x45, 0x2D, 0x42, \
+                                   0x45, 0x41, 0x43, 0x4F, LO_UINT16(uuid),     \
+                                   HI_UINT16(uuid), 0x00, 0x00
+
+#ifdef EVENT_LOG
+#define SERVAPP_NUM_ATTR_SUPPORTED 7
+#else
+#define SERVAPP_NUM_ATTR_SUPPORTED 5
+#endif
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Maintenance service UUID
+CONST uint8 maintServUUID[ATT_UUID_SIZE] =
+{
+  MAINT_BASE_UUID_128(MAINT_SERV_UUID)
+};
+
+// Telemetry characteristic UUID
+CONST uint8 maintTelemetryUUID[ATT_UUID_SIZE] =
+{
+  MAINT_BASE_UUID_128(MAINT_TELEMETRY_UUID)
+};
+
+// Configuration characteristic UUID
+CONST uint8 maintConfigUUID[ATT_UUID_SIZE] =
+{
+  MAINT_BASE_UUID_128(MAINT_CONFIG_UUID)
+};
+
+#ifdef EVENT_LOG
+// Event log characteristic UUID
+CONST uint8 maintLogUUID[ATT_UUID_SIZE] =
+{
+  MAINT_BASE_UUID_128(MAINT_LOG_UUID)
+};
+#endif
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+static maintServiceCBs_t *maintService_AppCBs = NULL;
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+// Maintenance Service attribute
+static CONST gattAttrType_t maintService = { ATT_UUID_SIZE, maintServUUID };
+
+// Telemetry Characteristic Properties
+static uint8 maintTelemetryProps = GATT_PROP_READ;
+
+// Telemetry Characteristic Value
+static uint8  maintTelemetry[MAINT_TELEMETRY_MAX_LEN];
+static uint16 maintTelemetryLen = 0;
+
+// Configuration Characteristic Properties
+static uint8 maintConfigProps = GATT_PROP_READ | GATT_PROP_WRITE;
+
+// Configuration Characteristic Value
+static uint8  maintConfig[MAINT_CONFIG_MAX_LEN];
+static uint16 maintConfigLen = 0;
+
+#ifdef EVENT_LOG
+// Event Log Characteristic Properties
+static uint8 maintLogProps = GATT_PROP_READ;
+
+// Event Log Characteristic Value
+static uint8  maintLog[MAINT_LOG_MAX_LEN];
+static uint16 maintLogLen = 0;
+#endif
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+static gattAttribute_t maintServiceAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
+{
+  // Maintenance Service
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&maintService                    /* pValue */
+  },
+
+    // Telemetry Characteristic Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &maintTelemetryProps
+    },
+
+      // Telemetry Characteristic Value
+      {
+        { ATT_UUID_SIZE, maintTelemetryUUID },
+        GATT_PERMIT_READ,
+        0,
+        maintTelemetry
+      },
+
+    // Configuration Characteristic Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &maintConfigProps
+    },
+
+      // Configuration Characteristic Value
+      {
+        { ATT_UUID_SIZE, maintConfigUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        maintConfig
+      },
+
+#ifdef EVENT_LOG
+    // Event Log Characteristic Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &maintLogProps
+    },
+
+      // Event Log Characteristic Value
+      {
+        { ATT_UUID_SIZE, maintLogUUID },
+        GATT_PERMIT_READ,
+        0,
+        maintLog
+      },
+#endif
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t maintService_ReadAttrCB(uint16_t connHandle,
+                                         gattAttribute_t *pAttr,
+                                         uint8_t *pValue, uint16_t *pLen,
+                                         uint16_t offset, uint16_t maxLen,
+                                         uint8_t method);
+static bStatus_t maintService_WriteAttrCB(uint16_t connHandle,
+                                          gattAttribute_t *pAttr,
+                                          uint8_t *pValue, uint16_t len,
+                                          uint16_t offset, uint8_t method);
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+// Maintenance Service Callbacks
+CONST gattServiceCBs_t maintServiceCBs =
+{
+  maintService_ReadAttrCB,  // Read callback function pointer
+  maintService_WriteAttrCB, // Write callback function pointer
+  NULL                      // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      MaintService_AddService
+ *
+ * @brief   Initializes the maintenance service by registering GATT
+ *          attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t MaintService_AddService(void)
+{
+  return GATTServApp_RegisterService(maintServiceAttrTbl,
+                                     GATT_NUM_ATTRS(maintServiceAttrTbl),
+                                     GATT_MAX_ENCRYPT_KEY_SIZE,
+                                     &maintServiceCBs);
+}
+
+/*********************************************************************
+ * @fn      MaintService_RegisterAppCBs
+ *
+ * @brief   Registers the application callback function.
+ *
+ * @param   appCallbacks - pointer to application callbacks.
+ *
+ * @return  SUCCESS or bleAlreadyInRequestedMode
+ */
+bStatus_t MaintService_RegisterAppCBs(maintServiceCBs_t *appCallbacks)
+{
+  if (appCallbacks)
+  {
+    maintService_AppCBs = appCallbacks;
+
+    return SUCCESS;
+  }
+
+  return bleAlreadyInRequestedMode;
+}
+
+/*********************************************************************
+ * @fn      MaintService_SetParameter
+ *
+ * @brief   Set a maintenance service parameter.
+ *
+ * @param   param - MAINT_TELEMETRY, MAINT_CONFIG or MAINT_LOG
+ * @param   len   - length of data to write
+ * @param   value - pointer to data to write
+ *
+ * @return  bStatus_t
+ */
+bStatus_t MaintService_SetParameter(uint8 param, uint16 len, void *value)
+{
+  switch (param)
+  {
+    case MAINT_TELEMETRY:
+      if (len > MAINT_TELEMETRY_MAX_LEN)
+      {
+        return bleInvalidRange;
+      }
+      memcpy(maintTelemetry, value, len);
+      maintTelemetryLen = len;
+      break;
+
+    case MAINT_CONFIG:
+      if (len > MAINT_CONFIG_MAX_LEN)
+      {
+        return bleInvalidRange;
+      }
+      memcpy(maintConfig, value, len);
+      maintConfigLen = len;
+      break;
+
+#ifdef EVENT_LOG
+    case MAINT_LOG:
+      if (len > MAINT_LOG_MAX_LEN)
+      {
+        return bleInvalidRange;
+      }
+      memcpy(maintLog, value, len);
+      maintLogLen = len;
+      break;
+#endif
+
+    default:
+      return INVALIDPARAMETER;
+  }
+
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      MaintService_GetParameter
+ *
+ * @brief   Get a maintenance service parameter.
+ *
+ * @param   param - MAINT_TELEMETRY or MAINT_CONFIG
+ * @param   value - pointer to data to put (parameter max length)
+ * @param   pLen  - returns the length of the parameter
+ *
+ * @return  bStatus_t
+ */
+bStatus_t MaintService_GetParameter(uint8 param, void *value, uint16 *pLen)
+{
+  switch (param)
+  {
+    case MAINT_TELEMETRY:
+      memcpy(value, maintTelemetry, maintTelemetryLen);
+      *pLen = maintTelemetryLen;
+      break;
+
+    case MAINT_CONFIG:
+      memcpy(value, maintConfig, maintConfigLen);
+      *pLen = maintConfigLen;
+      break;
+
+    default:
+      return INVALIDPARAMETER;
+  }
+
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn          maintService_ReadAttrCB
+ *
+ * @brief       Read an attribute. Long reads are served with the offset,
+ *              a single read covers the whole value with the max MTU.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t maintService_ReadAttrCB(uint16_t connHandle,
+                                         gattAttribute_t *pAttr,
+                                         uint8_t *pValue, uint16_t *pLen,
+                                         uint16_t offset, uint16_t maxLen,
+                                         uint8_t method)
+{
+  uint16 valueLen;
+
+  if (pAttr->pValue == maintTelemetry)
+  {
+    valueLen = maintTelemetryLen;
+  }
+  else if (pAttr->pValue == maintConfig)
+  {
+    valueLen = maintConfigLen;
+  }
+#ifdef EVENT_LOG
+  else if (pAttr->pValue == maintLog)
+  {
+    valueLen = maintLogLen;
+  }
+#endif
+  else
+  {
+    *pLen = 0;
+    return ATT_ERR_ATTR_NOT_FOUND;
+  }
+
+  if (offset > valueLen)
+  {
+    return ATT_ERR_INVALID_OFFSET;
+  }
+
+  *pLen = MIN(maxLen, valueLen - offset);
+  memcpy(pValue, pAttr->pValue + offset, *pLen);
+
+#ifdef EVENT_LOG
+  // The records leave the device once the last byte has been served
+  if ((pAttr->pValue == maintLog) && (valueLen > 0) &&
+      (offset + *pLen == valueLen) &&
+      maintService_AppCBs && maintService_AppCBs->pfnLogRead)
+  {
+    maintService_AppCBs->pfnLogRead();
+  }
+#endif
+
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      maintService_WriteAttrCB
+ *
+ * @brief   Validate attribute data prior to a write operation. Long
+ *          writes arrive as consecutive offsets once executed.
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pAttr - pointer to attribute
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ * @param   method - type of write message
+ *
+ * @return  SUCCESS, blePending or Failure
+ */
+static bStatus_t maintService_WriteAttrCB(uint16_t connHandle,
+                                          gattAttribute_t *pAttr,
+                                          uint8_t *pValue, uint16_t len,
+                                          uint16_t offset, uint8_t method)
+{
+  if (pAttr->pValue != maintConfig)
+  {
+    return ATT_ERR_ATTR_NOT_FOUND;
+  }
+
+  if (offset > maintConfigLen)
+  {
+    return ATT_ERR_INVALID_OFFSET;
+  }
+
+  if (offset + len > MAINT_CONFIG_MAX_LEN)
+  {
+    return ATT_ERR_INVALID_VALUE_SIZE;
+  }
+
+  memcpy(maintConfig + offset, pValue, len);
+  maintConfigLen = offset + len;
+
+  // The application parses the batch from its own task
+  if (maintService_AppCBs && maintService_AppCBs->pfnConfigChange)
+  {
+    maintService_AppCBs->pfnConfigChange();
+  }
+
+  return SUCCESS;
+}
+
+/*********************************************************************
+*********************************************************************/
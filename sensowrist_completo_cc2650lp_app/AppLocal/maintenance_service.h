@@ -0,0 +1,122 @@
+/******************************************************************************
+
+ @file  maintenance_service.h
+
+ @brief This file contains the smartcare-beacon maintenance GATT service
+        definitions and prototypes. The service is only reachable while
+        the connectable maintenance window is open.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef MAINTENANCE_SERVICE_H
+#define MAINTENANCE_SERVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+// Service parameters
+#define MAINT_TELEMETRY               0  // RW uint8 array - telemetry snapshot
+#define MAINT_CONFIG                  1  // RW uint8 array - signed command frame (configuration batch)
+#define MAINT_LOG                     2  // R  uint8 array - event log records (EVENT_LOG)
+
+// Service and characteristic UUIDs (16 bit part of the 128 bit UUID)
+#define MAINT_SERV_UUID               0xA550
+#define MAINT_TELEMETRY_UUID          0xA551
+#define MAINT_CONFIG_UUID             0xA552
+#define MAINT_LOG_UUID                0xA553
+
+// Characteristic value sizes. Both fit in a single ATT PDU with the
+// maximum MTU, shorter MTUs fall back to long reads/writes.
+#define MAINT_TELEMETRY_MAX_LEN       200
+#define MAINT_CONFIG_MAX_LEN          128
+#define MAINT_LOG_MAX_LEN             128
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+// Callback when the configuration characteristic has been written
+typedef void (*maintConfigChange_t)(void);
+
+// Callback when the event log value has been read up to its last byte
+typedef void (*maintLogRead_t)(void);
+
+typedef struct
+{
+  maintConfigChange_t pfnConfigChange;  // Called when configuration is written
+  maintLogRead_t      pfnLogRead;       // Called when the event log is read out (EVENT_LOG)
+} maintServiceCBs_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      MaintService_AddService
+ *
+ * @brief   Initializes the maintenance service by registering GATT
+ *          attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t MaintService_AddService(void);
+
+/*********************************************************************
+ * @fn      MaintService_RegisterAppCBs
+ *
+ * @brief   Registers the application callback function.
+ *
+ * @param   appCallbacks - pointer to application callbacks.
+ *
+ * @return  SUCCESS or bleAlreadyInRequestedMode
+ */
+bStatus_t MaintService_RegisterAppCBs(maintServiceCBs_t *appCallbacks);
+
+/*********************************************************************
+ * @fn      MaintService_SetParameter
+ *
+ * @brief   Set a maintenance service parameter.
+ *
+ * @param   param - MAINT_TELEMETRY, MAINT_CONFIG or MAINT_LOG
+ * @param   len   - length of data to write
+ * @param   value - pointer to data to write
+ *
+ * @return  bStatus_t
+ */
+bStatus_t MaintService_SetParameter(uint8 param, uint16 len, void *value);
+
+/*********************************************************************
+ * @fn      MaintService_GetParameter
+ *
+ * @brief   Get a maintenance service parameter.
+ *
+ * @param   param - MAINT_TELEMETRY or MAINT_CONFIG
+ * @param   value - pointer to data to put (parameter max length)
+ * @param   pLen  - returns the length of the parameter
+ *
+ * @return  bStatus_t
+ */
+bStatus_t MaintService_GetParameter(uint8 param, void *value, uint16 *pLen);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAINTENANCE_SERVICE_H */
@@ -48,6 +48,8 @@
 /*********************************************************************
  * INCLUDES
  */
+#include <string.h>
+
 #include <ti/sysbios/knl/Task.h>
 #include <ti/sysbios/knl/Clock.h>
 #include <ti/sysbios/knl/Semaphore.h>
@@ -57,7 +59,15 @@
 #include "gapgattserver.h"
 #include "gattservapp.h"
 
+#ifdef MAINTENANCE_WINDOW
+// Connectable maintenance window (predefined symbol MAINTENANCE_WINDOW)
+// oJo, link PROFILES/peripheral.c instead of broadcaster.c and build the
+// stack with PERIPHERAL_CFG and MAX_PDU_SIZE=251
+#include "peripheral.h"
+#include "maintenance_service.h"
+#else
 #include "broadcaster.h"
+#endif
 #include "gapbondmgr.h"
 
 #include "osal_snv.h"
@@ -72,15 +82,46 @@
 #include <ti/mw/display/Display.h>
 #include "board.h"
 #include "board_key.h"
+#include "board_led.h"
+#ifdef ACCEL_FALL_DETECT
+#include "board_accel.h"
+#include "fall_detect.h"
+#include "activity.h"
+#endif
+#include "siphash.h"
+#include "event_log.h"
 
 #include "simple_broadcaster.h"
 
 #include <driverlib/aon_batmon.h>
+#include <driverlib/aon_rtc.h>
+#include <inc/hw_types.h>
+#include <inc/hw_memmap.h>
+#include <inc/hw_fcfg1.h>
+#include <driverlib/sys_ctrl.h>
 
 
 /*********************************************************************
  * MACROS
  */
+// Automate invariant checks (predefined symbol AUTOMATE_CHECKS, debug
+// builds only): a failed check records its line and is reported on the
+// display, the device keeps running
+#ifdef AUTOMATE_CHECKS
+#define SBB_CHECK(cond)   do { if (!(cond)) SimpleBLEBroadcaster_checkFailed(__LINE__); } while (0)
+#else
+#define SBB_CHECK(cond)
+#endif
+
+// Wakeup attribution (predefined symbol POWER_MEASURE, bench builds only):
+// every wakeup handled by the application is counted per source and logged
+// in a RAM trace, read back with the debugger or in the maintenance
+// telemetry
+#ifdef POWER_MEASURE
+#define PM_WAKEUP(src)    SimpleBLEBroadcaster_pmWakeup(src)
+#else
+#define PM_WAKEUP(src)
+#endif
 
 /*********************************************************************
  * CONSTANTS
@@ -89,24 +130,53 @@
 #define BEACON_WRISTBAND
 //#define BEACON_KEYRINGUS
 
+// Firmware version advertised in the scan response (major.minor nibbles)
+#define FIRMWARE_VERSION                         0x12
 
+// PERIODO_ADVERTISING_EN_SEGUNDOS can be sized per site from the project
+// predefined symbols (--define PERIODO_ADVERTISING_EN_SEGUNDOS=n) once the
+// dense-room channel occupancy of the installation has been simulated
 #ifdef BEACON_WRISTBAND
+#ifndef PERIODO_ADVERTISING_EN_SEGUNDOS
 #define PERIODO_ADVERTISING_EN_SEGUNDOS          3
+#endif
 #define PERIODO_ADVERTISING_ALARMA_EN_SEGUNDOS   1
 
 #define EVENTOS_EN_UN_MINUTO                     60/PERIODO_ADVERTISING_ALARMA_EN_SEGUNDOS // Se usa para borrar la alarma
 #define LED_BLINK_DURATION_MS                    50 // Flashing led every PERIODO_ADVERTISING_ALARMA_EN_SEGUNDOS time
+
+// Alarm burst: first interval, doubled every ALARM_BURST_EVENTS_PER_STEP
+// events until ALARM_ADVERTISING_INTERVAL is reached (100, 200, 400, 800 ms).
+// The dither is drawn once per step, a new interval needs an advertising
+// restart; event to event the controller already adds the 0-10 ms
+// advDelay of the spec, which keeps co-located devices apart. The burst
+// time counts against the EVENTOS_EN_UN_MINUTO alarm window.
+#define ALARM_BURST_INTERVAL                     160 // units of 625us, 160=100ms
+#define ALARM_BURST_EVENTS_PER_STEP              3
+#define ALARM_BURST_JITTER                       16  // Max random dither (units of 625us, 16=10ms)
+
+#define DEFAULT_DEVICE_NAME                      "smartcare-wristband"
 #endif
 
 #ifdef BEACON_KEYRINGUS
+#ifndef PERIODO_ADVERTISING_EN_SEGUNDOS
 #define PERIODO_ADVERTISING_EN_SEGUNDOS          7
+#endif
 #define PERIODO_ADVERTISING_ALARMA_EN_SEGUNDOS   0
 
 #define EVENTOS_EN_UN_MINUTO                     0 // Alarm no allowed in keyringus mode
 #define LED_BLINK_DURATION_MS                    0 // Led on pressing pushbutton
+
+#define ALARM_BURST_INTERVAL                     0 // Alarm no allowed in keyringus mode
+#define ALARM_BURST_EVENTS_PER_STEP              0
+#define ALARM_BURST_JITTER                       1
+
+#define DEFAULT_DEVICE_NAME                      "smartcare-keyringus"
 #endif
 
+#ifndef PERIODO_ADV_KEEPALIVE_EN_SEGUNDOS
 #define PERIODO_ADV_KEEPALIVE_EN_SEGUNDOS        10
+#endif
 
 // Wakeup timer (in milliseconds)
 #define WAKEUP_TIMER                             10*1000 // Time pressing the button to start advertising
@@ -114,10 +184,131 @@
 // Key timers (in milliseconds)
 #define SHORTKEY_TIMER                           10*1000 // Time pressing the button to enter in keepalive state
 #define LONGKEY_TIMER                            20*1000 // Time pressing the button to enter in warehouse state
+#define MAINTKEY_TIMER                           30*1000 // Time pressing the button to open the maintenance window
+
+// Maintenance window
+#define MAINT_WINDOW_DURATION                    30*1000 // Window (and connection) lifetime in milliseconds
+#define MAINT_SCHEDULE_PERIODS                   1728    // Scheduled opening every 1728 BATTERY_PERIOD (24 hours)
+#define MAINT_ADVERTISING_INTERVAL               160     // Connectable advertising interval (units of 625us, 160=100ms)
+#define MAINT_CONN_INTERVAL_MIN                  6       // Connection interval (units of 1.25ms, 6=7.5ms)
+#define MAINT_CONN_INTERVAL_MAX                  12
+#define MAINT_CONN_TIMEOUT                       100     // Supervision timeout (units of 10ms, 100=1s)
+#define MAINT_PREPARE_WRITES                     4       // Queued prepare writes for long configuration writes
+
+// Command beacons (predefined symbol COMMAND_SCAN)
+// oJo, needs the stack built with OBSERVER_CFG and the GAP role started
+// with GAP_PROFILE_OBSERVER (broadcaster/peripheral PLUS_OBSERVER)
+// Added cost: CMD_SCAN_DURATION of RX (~6 mA) every CMD_SCAN_PERIOD,
+// 30 ms per minute ~ 3 uA average
+#define CMD_SCAN_PERIOD                          (60*1600) // Scan after the first advertising event past 60 s (units of 625us)
+#define CMD_SCAN_DURATION                        30      // Scan window in milliseconds
+#define CMD_SCAN_WINDOW                          48      // Scan interval and window (units of 625us, 48=30ms)
+
+// Alarm relay (predefined symbol ALARM_RELAY, opt-in with CFG_RELAY_ENABLE)
+// Alarm status frames heard from other wristbands are re-advertised in a
+// relay slot for RELAY_EVENTS advertising events. Same scan path as the
+// command beacons. The window outlasts one alarm interval (1 s plus the
+// 0-10 ms advDelay), so an alarm on air is heard by any window opened
+// during it, and a window opens at most RELAY_SCAN_PERIOD plus one
+// keep-alive interval (55 s) apart, inside the one minute alarm. Still
+// best effort: a window is skipped while the device advertises its own
+// alarm, and a colliding packet is lost.
+// Added cost, only while CFG_RELAY_ENABLE is set: RELAY_SCAN_DURATION of
+// RX (~6 mA) every RELAY_SCAN_PERIOD, ~140 uA average
+#define RELAY_SCAN_PERIOD                        (45*1600) // Scan after the first advertising event past 45 s (units of 625us)
+#define RELAY_SCAN_DURATION                      1030    // Scan window in milliseconds
+#define RELAY_SCAN_WINDOW                        1648    // Scan interval and window (units of 625us, 1648=1030ms)
+#define RELAY_EVENTS                             30      // Advertising events a heard alarm is relayed for
+#define RELAY_MAX_HOPS                           2       // Relayed frames are relayed again up to this hop count
+
+// Scan windows after advertising events, shared by the command beacons and
+// the alarm relay (the relay windows also serve the commands). The timing
+// follows the run time relay setting, the command timing when it is off.
+#if defined(ALARM_RELAY) || defined(COMMAND_SCAN)
+#define SBB_SCAN
+#endif
+#ifdef ALARM_RELAY
+#define SCAN_RELAY                               (appConfig.relayEnable)
+#else
+#define SCAN_RELAY                               FALSE
+#endif
+#define SCAN_PERIOD                              (SCAN_RELAY? RELAY_SCAN_PERIOD : CMD_SCAN_PERIOD)
+#define SCAN_DURATION                            (SCAN_RELAY? RELAY_SCAN_DURATION : CMD_SCAN_DURATION)
+#define SCAN_WINDOW                              (SCAN_RELAY? RELAY_SCAN_WINDOW : CMD_SCAN_WINDOW)
+
+// Signed gateway commands, heard in the scan windows (COMMAND_SCAN) or
+// written to the maintenance configuration characteristic, so an open
+// maintenance window is no way around the command key
+#if defined(COMMAND_SCAN) || defined(MAINTENANCE_WINDOW)
+#define SBB_COMMANDS
+#endif
+
+// Advertising slots: status events sent between two extra slots (the
+// extras take turns: iBeacon, telemetry, Eddystone-TLM), 0 status only
+#define ADV_SLOT_RATIO                           4
+
+// iBeacon identity: site UUID (--define to override), major/minor from the
+// serial number, measured power at 1 m follows the TX power in use
+#ifndef IBEACON_UUID
+#define IBEACON_UUID   0x53, 0x4D, 0x43, 0x41, 0x52, 0x45, 0x2D, 0x42, \
+                       0x45, 0x41, 0x43, 0x4F, 0x4E, 0x00, 0x00, 0x01
+#endif
+
+// Low battery degradation ladder (see battTiers): a tier is entered below
+// its threshold and left BATT_TIER_HYSTERESIS_MV above it
+#define BATT_TIER_HYSTERESIS_MV                  100
+
+// TX power control: gateways report the delivery ratio they observe
+// (CFG_RX_QUALITY, by command beacon or maintenance window), power steps
+// down while reception is good and back up when it degrades. Without
+// feedback for TX_FEEDBACK_TIMEOUT battery periods the full tier power
+// is restored.
+#define TX_QUALITY_GOOD                          95      // Delivery ratio (%) to step down
+#define TX_QUALITY_POOR                          80      // Delivery ratio (%) to step up
+#define TX_STEP_UP                               2       // Steps up on poor reception
+#define TX_FEEDBACK_TIMEOUT                      36      // Battery periods (30 minutes)
+#define IBEACON_RSSI_0DBM                        (-59)   // iBeacon RSSI at 1 m for 0 dBm
+
+// Advertising decorrelation: every device advertises at its own fixed
+// offset from the nominal interval, and waits a random part of the
+// interval when advertising starts from stopped, so that devices powered
+// up or activated together do not stay in step
+#define ADV_DITHER_SPAN                          32      // Max per device offset (units of 625us, 32=20ms)
+
+// Alarm drain bound checked by AUTOMATE_CHECKS: burst steps (at most 7
+// doublings up to 16384) plus the steady alarm events
+#define ALARM_DRAIN_MAX_EVENTS                   (EVENTOS_EN_UN_MINUTO + 8*ALARM_BURST_EVENTS_PER_STEP)
+
+// Stillness (ACCEL_FALL_DETECT): after STILL_TIME seconds without motion
+// (0 disables) the normal advertising slows down to the longest interval
+// until the sensor or the key reports motion again
+#define STILL_TIME                               300     // Seconds (10-1300)
+#define STILL_ADVERTISING_INTERVAL               16000   // units of 625us, 16000=10s
+
+// Wakeup trace (POWER_MEASURE): records of 4 bytes, source in bits 31:28
+// and Clock ticks (10 us) in bits 27:0
+#define PM_TRACE_LEN                             128
+
+// Battery history served in the maintenance telemetry
+#define BATT_HISTORY_LEN                         96      // Samples kept (4 days)
+#define BATT_HISTORY_PERIODS                     72      // One sample every 72 BATTERY_PERIOD (1 hour)
 
 // Initial led gretting (in milliseconds)
 #define HELLOWORLD_TIMER                         5*1000  // Initial led ON timer
 
+// Warehouse shutdown (POWER_SAVING): delay before entering shutdown, lets
+// the warehouse led pattern and the SNV writes complete
+#define SHUTDOWN_DELAY                           2500
+
+// Led patterns (board_led), one on time counter each for the energy report
+#define LED_PATTERN_HELLO        0   // Power up greeting
+#define LED_PATTERN_ALARM        1   // Flash on every steady alarm advertising event
+#define LED_PATTERN_MAINTENANCE  2   // Maintenance window opened
+#define LED_PATTERN_WAREHOUSE    3   // Back to warehouse
+#define LED_PATTERN_KEEPALIVE    4   // Keepalive advertising
+#define LED_PATTERN_KEY          5   // On while the key is pressed (keyringus)
+#define LED_PATTERN_COUNT        6
+
 // Battery period (in milliseconds)
 #define BATTERY_PERIOD                           50*1000 // Battery measure period in seconds
 
@@ -126,6 +317,17 @@
 #define DEFAULT_ADVERTISING_INTERVAL        (PERIODO_ADVERTISING_EN_SEGUNDOS*1600)
 #define ALARM_ADVERTISING_INTERVAL          (PERIODO_ADVERTISING_ALARMA_EN_SEGUNDOS*1600)
 
+#if (DEFAULT_ADVERTISING_INTERVAL > 16384) || (LONG_ADVERTISING_INTERVAL > 16384)
+#error "Advertising period out of range (max 10 seconds)"
+#endif
+#if (PERIODO_ADVERTISING_EN_SEGUNDOS < 1) || (PERIODO_ADV_KEEPALIVE_EN_SEGUNDOS < 1)
+#error "Advertising period out of range (min 1 second)"
+#endif
+#if defined(ALARM_RELAY) && defined(BEACON_WRISTBAND) && \
+    (RELAY_SCAN_PERIOD + LONG_ADVERTISING_INTERVAL > (EVENTOS_EN_UN_MINUTO)*ALARM_ADVERTISING_INTERVAL)
+#error "Relay scan windows too far apart for the alarm window"
+#endif
+
 // Task configuration
 #define SBB_TASK_PRIORITY                     1
 
@@ -133,15 +335,31 @@
 #define SBB_TASK_STACK_SIZE                   660
 #endif
 
-// Internal Events for RTOS application
+// Internal Events for RTOS application: queued message events, values
+// matched one by one in SimpleBLEBroadcaster_processAppMsg, not bit flags
 #define SBB_STATE_CHANGE_EVT                  0x0001
 #define SBB_KEY_CHANGE_EVT                    0x0002
 //#define SBB_LONGKEY_TIMEOUT_EVT               0x0004
 //#define SBB_SHORTKEY_TIMEOUT_EVT              0x0008
+#define SBB_ACCEL_EVT                         0x0003
+#define SBB_MOTION_EVT                        0x0004
+#define SBB_SHUTDOWN_EVT                      0x0005
+#define SBB_ADV_START_EVT                     0x0006
+#define SBB_MAINT_OPEN_EVT                    0x0007
+#define SBB_MAINT_CLOSE_EVT                   0x0008
+#define SBB_MAINT_CONFIG_EVT                  0x0009
+#define SBB_MAINT_LOG_READ_EVT                0x000A
+
+// ICall event flag of the advertising event notice, not a queued event
 #define SBB_ADV_EVT                    		  0x0080
 
 // Customer NV Items - Range 0x80 - 0x8F -
 #define SNV_ID_CONFIG          0x80
+#define SNV_ID_DEVNAME         0x81
+#define SNV_ID_SERIAL          0x82
+#define SNV_ID_APPCONFIG       0x83
+#define SNV_ID_CMDKEY          0x84
+#define SNV_ID_CMDSEQ          0x85
 
 // Flags in SNV_CONFIG register
 #define FLAG_FIRST_INI         0x01
@@ -152,11 +370,105 @@
 #define STATE_ADV_NORMAL       0x02
 #define STATE_ADV_ALARM        0x03
 #define STATE_ADV_KEEPALIVE    0x04
+#define STATE_ADV_STILL        0x05
 
 #define ADV_STOP               0x01
 #define ADV_DEFAULT            0x02
 #define ADV_ALARM              0x03
 #define ADV_KEEPALIVE          0x04
+#define ADV_MAINTENANCE        0x05
+#define ADV_STILL              0x06
+
+// Scannable advertising (predefined symbol SCAN_RSP_METADATA), device
+// metadata served in the scan response to active scanners. Opt-in: every
+// event then opens an RX window and answers every active scanner in range
+#ifdef SCAN_RSP_METADATA
+#define ADV_EVENT_TYPE         GAP_ADTYPE_ADV_SCAN_IND    // use scannable undirected adv
+#else
+#define ADV_EVENT_TYPE         GAP_ADTYPE_ADV_NONCONN_IND // use non-connectable adv
+#endif // SCAN_RSP_METADATA
+
+// Configuration batch records: id, length, value
+#define CFG_ADV_PERIOD         0x01   // uint8, seconds (1-10)
+#define CFG_KEEPALIVE_PERIOD   0x02   // uint8, seconds (1-10)
+#define CFG_DEVICE_NAME        0x03   // 1 to SCAN_RSP_NAME_MAX_LEN chars
+#define CFG_LED_ENABLE         0x04   // uint8, 0 or 1
+#define CFG_SLOT_RATIO         0x05   // uint8, status events per extra slot (0-20)
+#define CFG_RX_QUALITY         0x06   // uint8, delivery ratio seen by gateways (0-100 %), not stored
+#define CFG_STILL_TIME         0x07   // uint16 LE, seconds (0 off, 10-1300)
+#define CFG_RELAY_ENABLE       0x08   // uint8, 0 or 1
+
+// Maintenance telemetry header (followed by the battery history)
+#define TELEMETRY_HDR_LEN      (12 + 2*LED_PATTERN_COUNT)
+
+
+// Scan response: complete name AD + metadata AD (max size = 31 bytes)
+#define SCAN_RSP_META_LEN      10
+#define SCAN_RSP_NAME_MAX_LEN  (31 - SCAN_RSP_META_LEN - 2)
+
+// Manufacturer specific frame markers
+#define FRAME_STATUS           0x41
+#define FRAME_COMMAND          0x43
+#define FRAME_METADATA         0x4D
+#define FRAME_RELAY            0x52
+#define FRAME_TELEMETRY        0x54
+
+// Wakeup sources (POWER_MEASURE)
+#define PM_SRC_ADV             0      // Advertising event notice
+#define PM_SRC_STACK           1      // Other stack messages (scan, connection)
+#define PM_SRC_KEY             2      // Key edge (pin wakeup plus debounce clock)
+#define PM_SRC_KEY_TIMER       3      // Short, long and maintenance key clocks
+#define PM_SRC_BATTERY         4      // Battery measure clock
+#define PM_SRC_MAINT           5      // Maintenance window clock
+#define PM_SRC_ACCEL           6      // Accelerometer FIFO watermark
+#define PM_SRC_ADV_START       7      // Advertising start clock
+#define PM_SRC_SHUTDOWN        8      // Warehouse shutdown clock
+#define PM_SRC_COUNT           9
+
+// Maintenance telemetry wakeup report (POWER_MEASURE), after the battery
+// history: wakeups per source, led clock wakeups, task active time and
+// the 5 dispatcher counters
+#ifdef POWER_MEASURE
+#define TELEMETRY_PM_LEN       (4*PM_SRC_COUNT + 28)
+#else
+#define TELEMETRY_PM_LEN       0
+#endif
+#define TELEMETRY_MAX_LEN      (TELEMETRY_HDR_LEN + BATT_HISTORY_LEN + TELEMETRY_PM_LEN)
+
+#ifdef MAINTENANCE_WINDOW
+// Maintenance buffer: telemetry snapshot, configuration batch and log
+// records are composed one at a time in it
+#if (TELEMETRY_MAX_LEN > MAINT_CONFIG_MAX_LEN)
+#define MAINT_BUFFER_LEN       TELEMETRY_MAX_LEN
+#else
+#define MAINT_BUFFER_LEN       MAINT_CONFIG_MAX_LEN
+#endif
+
+#if (TELEMETRY_MAX_LEN > MAINT_TELEMETRY_MAX_LEN) || (MAINT_LOG_MAX_LEN > MAINT_BUFFER_LEN)
+#error "Maintenance telemetry too long"
+#endif
+#endif
+
+// Advertising slots
+#define ADV_SLOT_STATUS        0
+#define ADV_SLOT_IBEACON       1
+#define ADV_SLOT_TELEMETRY     2
+#define ADV_SLOT_TLM           3
+#define ADV_SLOT_RELAY         4
+
+// Eddystone service UUID and TLM frame
+#define EDDYSTONE_UUID         0xFEAA
+#define EDDYSTONE_FRAME_TLM    0x20
+
+// Command frame: marker, seq (2), target (4), opcode, payload, mac (4)
+// target is the full serial number, 0xFFFFFFFF for all devices
+#define CMD_HDR_LEN            8
+#define CMD_MAC_LEN            4
+#define CMD_TARGET_ALL         0xFFFFFFFF
+
+// Command opcodes
+#define CMD_CONFIG             0x01   // payload: configuration batch records
+#define CMD_STATE              0x02   // payload: STATE_WAREHOUSE/ADV_NORMAL/ADV_KEEPALIVE
 
 /*********************************************************************
  * TYPEDEFS
@@ -165,8 +477,45 @@
 typedef struct
 {
   appEvtHdr_t hdr; // Event header.
+#ifdef POWER_MEASURE
+  uint32_t    ticks; // Enqueue time, queue residency
+#endif
 } sbbEvt_t;
 
+// Device name as stored in SNV
+typedef struct
+{
+  uint8_t len;
+  uint8_t name[SCAN_RSP_NAME_MAX_LEN];
+} sbbDevName_t;
+
+// Runtime configuration as stored in SNV
+typedef struct
+{
+  uint8_t advPeriod;        // Seconds between normal advertising events
+  uint8_t keepalivePeriod;  // Seconds between keepalive advertising events
+  uint8_t ledEnable;        // Led signalling enabled
+  uint8_t slotRatio;        // Status events between two extra slots, 0 status only
+  uint16_t stillTime;       // Seconds without motion before slowing down, 0 off
+  uint8_t relayEnable;      // Relay alarms heard from other wristbands
+} sbbConfig_t;
+
+// Low battery degradation tier
+typedef struct
+{
+  uint16_t enterMv;         // Entered below this battery voltage
+  uint8_t  txPower;         // Max HCI_EXT_TX_POWER_xxx outside alarms
+  uint8_t  intervalMult;    // Normal/keepalive interval multiplier
+  uint8_t  ledEnable;       // Led patterns other than alarm allowed
+} sbbBattTier_t;
+
+// Precomposed advertising slot
+typedef struct
+{
+  uint8_t *pData;
+  uint8_t  len;
+} sbbAdvSlot_t;
+
 
 /*********************************************************************
  * GLOBAL VARIABLES
@@ -185,6 +534,29 @@ Display_Handle dispHandle = NULL;
  */
 
 
+#ifdef POWER_MEASURE
+// Wakeups per source, application task active time (Clock ticks) and
+// wakeup trace
+uint32_t pmWakeups[PM_SRC_COUNT];
+uint32_t pmActiveTicks = 0;
+uint32_t pmTrace[PM_TRACE_LEN];
+uint8_t  pmTraceIdx = 0;
+
+// Dispatcher: wakes with work, messages handled, largest batch and worst
+// queue residency (Clock ticks) of alarm (key, fall) and other app messages
+uint32_t pmDispatchWakes = 0;
+uint32_t pmDispatchMsgs = 0;
+uint8_t  pmBatchMax = 0;
+uint32_t pmAlarmLatencyMax = 0;
+uint32_t pmAppLatencyMax = 0;
+#endif
+
+#ifdef AUTOMATE_CHECKS
+// Line of the last failed invariant check and number of failures
+uint16_t sbbCheckFailLine = 0;
+uint16_t sbbCheckFailCount = 0;
+#endif
+
 /*********************************************************************
  * LOCAL VARIABLES
  */
@@ -198,15 +570,136 @@ static ICall_Semaphore sem;
 static Queue_Struct appMsg;
 static Queue_Handle appMsgQueue;
 
+// Queue object used for the messages that can raise an alarm (key, fall),
+// served ahead of the stack messages and appMsgQueue
+static Queue_Struct alarmMsg;
+static Queue_Handle alarmMsgQueue;
+
 // Alarm counter
 static uint8_t alarmCounter=0;
 
+// Alarm burst interval (0 when the burst has decayed to the steady rate)
+static uint16_t alarmBurstInterval = 0;
+static uint8_t  alarmBurstEvents = 0;
+
+// Burst time not yet taken from alarmCounter (units of 625us)
+static uint16_t alarmBurstTime = 0;
+
+#ifdef ACCEL_FALL_DETECT
+// Fall detector and activity estimator states, accelerometer batch buffer
+static fallDetect_t  fallDetect;
+static activity_t    activity;
+static accelSample_t accelBatch[ACCEL_BATCH_SAMPLES];
+
+// Last motion state reported by the sensor
+static bool accelMoving = true;
+#endif
+
+// Pseudo random generator state (xorshift32), seeded with the BD address
+static uint32_t advRandState = 0x2545F491;
+
+// Per device advertising interval offset (units of 625us), and delayed
+// advertising start (interval to start with)
+static uint16_t advDither = 0;
+static bool     advStartPending = false;
+static uint16_t advStartInterval;
+
 // Battery value
 static uint8_t batt;
 
+// Battery voltage (mV) and temperature (C) of the last measure (TLM)
+static uint16_t battMv;
+static int8_t   battTemp;
+
+// Advertising events since power up (TLM)
+static uint32_t advCount = 0;
+
+// Low battery degradation ladder. Alarms always advertise at 5 dBm and
+// ALARM_ADVERTISING_INTERVAL, whatever the tier.
+static const sbbBattTier_t battTiers[] =
+{
+  { 0xFFFF, HCI_EXT_TX_POWER_5_DBM,        1, TRUE  },
+  { 2600,   HCI_EXT_TX_POWER_0_DBM,        1, FALSE },
+  { 2400,   HCI_EXT_TX_POWER_MINUS_6_DBM,  2, FALSE },
+  { 2200,   HCI_EXT_TX_POWER_MINUS_12_DBM, 3, FALSE }
+};
+static uint8_t battTier = 0;
+
+// Output power in dBm, indexed by HCI_EXT_TX_POWER_xxx
+static const int8_t txPowerDbm[] =
+{
+  -21, -18, -15, -12, -9, -6, -3, 0, 1, 2, 3, 4, 5
+};
+
+// TX power steps below the tier power and battery periods since the
+// last reception feedback
+static uint8_t txPowerReduction = 0;
+static uint8_t txFeedbackAge = 0;
+
+// Battery history summary (min/max since power up), 0 until first measure
+static uint8_t battMin;
+static uint8_t battMax;
+
+// Battery history, one sample every BATT_HISTORY_PERIODS measures
+static uint8_t battHistory[BATT_HISTORY_LEN];
+static uint8_t battHistoryIdx = 0;
+static uint8_t battHistoryCount = 0;
+static uint8_t battHistoryDivider = 0;
+
+// Alarms raised since power up
+static uint16_t alarmsRaised = 0;
+
+// Time base (1/8 s) when the last alarm was raised
+static uint16_t alarmTime = 0;
+
+// Advertising interval in use (units of 625us)
+static uint16_t advIntervalActive = 0;
+
+#ifdef AUTOMATE_CHECKS
+// Advertising events since the last alarm was raised
+static uint16_t alarmDrainEvents = 0;
+#endif
+
 // Systen flag
 static bool keyTimeoutShort = false;
 static bool keyTimeoutLong  = false;
+#ifdef MAINTENANCE_WINDOW
+static bool keyTimeoutMaint = false;
+
+// Maintenance window
+static bool     maintWindowOpen = false;
+static bool     maintConnected  = false;
+static uint16_t maintScheduleCount = 0;
+static uint8_t  advTypeActive = ADV_EVENT_TYPE;
+
+// Kept off the task stack, the GAP and GATT call chains need it
+static uint8_t  maintBuffer[MAINT_BUFFER_LEN];
+#endif
+
+// Runtime configuration
+static sbbConfig_t appConfig =
+{
+  PERIODO_ADVERTISING_EN_SEGUNDOS,
+  PERIODO_ADV_KEEPALIVE_EN_SEGUNDOS,
+  TRUE,
+  ADV_SLOT_RATIO,
+  STILL_TIME,
+  FALSE
+};
+
+#ifdef SBB_SCAN
+// Scan window scheduling: advertising time since the last window (units
+// of 625us)
+static uint32_t scanElapsed = 0;
+static bool     scanning  = false;
+#endif
+
+#ifdef SBB_COMMANDS
+// Command beacons: key and last accepted sequence
+static bool     cmdKeyValid  = false;
+static uint8_t  cmdKey[SIPHASH_KEY_LEN];
+static uint16_t cmdSeq = 0;
+#endif
 
 // No volatile configuration register
 static uint8_t snvConfigReg;
@@ -218,32 +711,26 @@ static uint8_t appState = STATE_WAREHOUSE;
 Task_Struct sbbTask;
 Char sbbTaskStack[SBB_TASK_STACK_SIZE];
 
-// GAP - SCAN RSP data (max size = 31 bytes)
-// oJo, not used in advertising not connectable mode
-static uint8 scanRspData[] =
-{
-#ifdef BEACON_WRISTBAND
-  // complete name
-  0x14,   // length of this data
-  GAP_ADTYPE_LOCAL_NAME_COMPLETE,
-  's','m','a','r','t','c','a','r','e','-','w','r','i','s','t','b','a','n','d',
-#endif
-
-#ifdef BEACON_KEYRINGUS
-  // complete name
-  0x14,   // length of this data
-  GAP_ADTYPE_LOCAL_NAME_COMPLETE,
-  's','m','a','r','t','c','a','r','e','-','k','e','y','r','i','n','g','u','s',
-#endif
+// Device name and serial number served in the scan response
+static sbbDevName_t devName;
+static uint8_t devSerial[4];
 
-  // Tx power level
-  0x02,   // length of this data
-  GAP_ADTYPE_POWER_LEVEL,
-  0       // 0dBm
-};
+// GAP - SCAN RSP data (max size = 31 bytes), composed at run time by
+// SimpleBLEBroadcaster_updateScanRsp() only when its contents change
+// oJo, only requested by scanners in scannable mode (SCAN_RSP_METADATA)
+static uint8 scanRspData[31];
+static bool  scanRspDirty = true;
 
 // GAP - Advertisement data (max size = 31 bytes, though this is
 // best kept short to conserve power while advertisting)
+// Status frame, as decoded by the gateways:
+//   [5] FRAME_STATUS
+//   [6] status: bit 7 alarm, bit 6 low battery degraded tier,
+//       bits 5:0 battery (bits 5:4 volts, 3:0 tenths)
+//   [7] status frame counter (wraps), +1 per status frame sent (the
+//       extra slots do not count), gaps show lost packets
+//   [8..9] time base (1/8 s, wraps, little endian): transmit time of the
+//       packet, or time the alarm was raised while bit 7 is set
 uint8 advertData[] =
 {
   // Flags; this sets the device to use limited discoverable
@@ -255,27 +742,151 @@ uint8 advertData[] =
 
 
   // three-byte broadcast of the data "1 2 3"
-  0x04,   // length of this data including the data type byte
+  0x06,   // length of this data including the data type byte
   GAP_ADTYPE_MANUFACTURER_SPECIFIC, // manufacturer specific adv. data type
-  0x41,
-  0, // status
-  0  // counter
+  FRAME_STATUS,
+  0,   // status
+  0,   // counter
+  0, 0 // time base
+};
+
+// GAP - iBeacon slot, major/minor filled in at GAPROLE_STARTED
+static uint8 advIBeacon[] =
+{
+  0x02,
+  GAP_ADTYPE_FLAGS,
+  GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED|GAP_ADTYPE_FLAGS_GENERAL,
+
+  0x1A,
+  GAP_ADTYPE_MANUFACTURER_SPECIFIC,
+  0x4C, 0x00,  // Apple company id
+  0x02, 0x15,  // iBeacon type and length
+  IBEACON_UUID,
+  0, 0,        // major
+  0, 0,        // minor
+  (uint8)(IBEACON_RSSI_0DBM + 5) // measured power, 5 dBm
+};
+
+// GAP - Telemetry slot, recomposed after each battery measure
+static uint8 advTelemetry[] =
+{
+  0x02,
+  GAP_ADTYPE_FLAGS,
+  GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED|GAP_ADTYPE_FLAGS_GENERAL,
+
+  0x0E,
+  GAP_ADTYPE_MANUFACTURER_SPECIFIC,
+  FRAME_TELEMETRY,
+  0,    // state
+  0,    // battery
+  0,    // battery min
+  0, 0, // alarms raised
+  0, 0, // uptime in hours
+  0,    // battery tier
+  0, 0, // steps (modulo 65536, 0 without accelerometer)
+  0, 0  // active minutes
+};
+static bool advTelemetryDirty = true;
+
+// GAP - Eddystone-TLM slot, counters refreshed when the slot is picked
+static uint8 advTlm[] =
+{
+  0x02,
+  GAP_ADTYPE_FLAGS,
+  GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED|GAP_ADTYPE_FLAGS_GENERAL,
+
+  0x03,
+  GAP_ADTYPE_16BIT_COMPLETE,
+  LO_UINT16(EDDYSTONE_UUID), HI_UINT16(EDDYSTONE_UUID),
+
+  0x11,
+  GAP_ADTYPE_SERVICE_DATA,
+  LO_UINT16(EDDYSTONE_UUID), HI_UINT16(EDDYSTONE_UUID),
+  EDDYSTONE_FRAME_TLM,
+  0x00,       // TLM version
+  0, 0,       // battery voltage (mV, big endian)
+  0x80, 0x00, // temperature (8.8 fixed point, big endian), 0x8000 not supported
+  0, 0, 0, 0, // advertising count (big endian)
+  0, 0, 0, 0  // uptime (0.1 s, big endian)
+};
+
+#ifdef ALARM_RELAY
+// GAP - Relay slot, alarm heard from another wristband
+static uint8 advRelay[] =
+{
+  0x02,
+  GAP_ADTYPE_FLAGS,
+  GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED|GAP_ADTYPE_FLAGS_GENERAL,
+
+  0x0D,
+  GAP_ADTYPE_MANUFACTURER_SPECIFIC,
+  FRAME_RELAY,
+  0,                // hops, 1 when heard from the source itself
+  0, 0, 0, 0, 0, 0, // source device address
+  0,                // source status
+  0,                // source advertising event counter
+  0, 0              // source time base
+};
+
+// Advertising events left relaying, 0 when idle
+static uint8_t relayEvents = 0;
+#endif
+
+// Advertising slots, indexed by ADV_SLOT_xxx
+static const sbbAdvSlot_t advSlots[] =
+{
+  { advertData,   sizeof(advertData)   },
+  { advIBeacon,   sizeof(advIBeacon)   },
+  { advTelemetry, sizeof(advTelemetry) },
+  { advTlm,       sizeof(advTlm)       },
+#ifdef ALARM_RELAY
+  { advRelay,     sizeof(advRelay)     }
+#endif
 };
 
-PIN_State  ledCtrlState;
-PIN_Config ledCtrlCfg[] =
+// Extra slots sent in turn every appConfig.slotRatio status events
+static const uint8_t advSlotExtras[] = { ADV_SLOT_IBEACON, ADV_SLOT_TELEMETRY, ADV_SLOT_TLM };
+static uint8_t advSlotCount = 0;
+static uint8_t advSlotExtra = 0;
+
+// Led pattern steps (flash)
+static const uint16_t ledStepsHello[]       = { LED_ON(HELLOWORLD_TIMER) };
+static const uint16_t ledStepsAlarm[]       = { LED_ON(LED_BLINK_DURATION_MS), LED_OFF(LED_UNTIL_ADV) };
+static const uint16_t ledStepsMaintenance[] = { LED_ON(1000) };
+static const uint16_t ledStepsWarehouse[]   = { LED_ON(2000) };
+static const uint16_t ledStepsKeepalive[]   = { LED_ON(500) };
+static const uint16_t ledStepsKey[]         = { LED_ON(LED_HOLD) };
+
+// Led patterns, indexed by LED_PATTERN_xxx
+static const ledPattern_t ledPatterns[LED_PATTERN_COUNT] =
 {
-		Board_LED1    | PIN_GPIO_OUTPUT_EN | PIN_GPIO_LOW   | PIN_PUSHPULL | PIN_DRVSTR_MAX,     /* LED initially off               */
-		PIN_TERMINATE
+  { ledStepsHello,       1, FALSE },
+  { ledStepsAlarm,       2, TRUE  },
+  { ledStepsMaintenance, 1, FALSE },
+  { ledStepsWarehouse,   1, FALSE },
+  { ledStepsKeepalive,   1, FALSE },
+  { ledStepsKey,         1, FALSE }
 };
-PIN_Handle ledCtrlHandle;
+
+// Led on time per pattern in milliseconds (energy report)
+static uint32_t ledOnTime[LED_PATTERN_COUNT];
 
 // Timers
-static Clock_Struct initialLEDTimer;
 static Clock_Struct batteryMeasureTimer;
+static Clock_Struct advStartTimer;
 static Clock_Struct wakeupTimer;
 static Clock_Struct shortkeyTimer;
 static Clock_Struct longkeyTimer;
+#ifdef MAINTENANCE_WINDOW
+static Clock_Struct maintkeyTimer;
+static Clock_Struct maintWindowTimer;
+#endif
+#ifdef POWER_SAVING
+static Clock_Struct shutdownTimer;
+
+// Woken from shutdown by KEY_1, the press is still held at startup
+static bool keyWakeHeld = false;
+#endif
 
 
 /*********************************************************************
@@ -286,9 +897,11 @@ static void SimpleBLEBroadcaster_taskFxn(UArg a0, UArg a1);
 
 static void SimpleBLEBroadcaster_processStackMsg(ICall_Hdr *pMsg);
 static void SimpleBLEBroadcaster_processAppMsg(sbbEvt_t *pMsg);
+static void SimpleBLEBroadcaster_dispatchAppMsg(Queue_Handle msgQueue);
 static void SimpleBLEBroadcaster_processStateChangeEvt(gaprole_States_t newState);
 
 static void SimpleBLEBroadcaster_stateChangeCB(gaprole_States_t newState);
+static void SimpleBLEBroadcaster_enqueueMsg(uint8_t event, uint8_t state);
 
 void SimpleBLEBroadcaster_keyChangeHandler(uint8 keys);
 
@@ -296,12 +909,111 @@ void SimpleBLEPeripheral_atuomateHandler(uint8 keys);
 
 void setAdvIntData(uint8_t adv_mode);
 
-static void InitialLEDTimingHandler(UArg a0)
+static void setAdvInterval(uint16_t advInt);
+
+static void SimpleBLEBroadcaster_updateScanRsp(void);
+#ifdef SBB_COMMANDS
+static void SimpleBLEBroadcaster_setDeviceName(const uint8_t *pName, uint8_t len);
+#endif
+static uint8_t SimpleBLEBroadcaster_nextAdvSlot(void);
+static void SimpleBLEBroadcaster_updateTelemetrySlot(void);
+static void SimpleBLEBroadcaster_updateTlmSlot(void);
+static void SimpleBLEBroadcaster_updateBattTier(void);
+static uint8_t SimpleBLEBroadcaster_txPower(void);
+static void SimpleBLEBroadcaster_applyTxPower(void);
+#ifdef SBB_COMMANDS
+static void SimpleBLEBroadcaster_txFeedback(uint8_t quality);
+#endif
+static void SimpleBLEBroadcaster_restoreAdv(void);
+#ifdef SBB_COMMANDS
+static bool SimpleBLEBroadcaster_applyConfig(const uint8_t *pBatch, uint16_t len);
+#endif
+#ifdef AUTOMATE_CHECKS
+static void SimpleBLEBroadcaster_checkInvariants(uint8_t key);
+static void SimpleBLEBroadcaster_checkFailed(uint16_t line);
+#endif
+
+#ifdef MAINTENANCE_WINDOW
+static void setAdvType(uint8_t advType);
+static void SimpleBLEBroadcaster_openMaintWindow(void);
+static void SimpleBLEBroadcaster_closeMaintWindow(void);
+static void SimpleBLEBroadcaster_updateTelemetry(void);
+#ifdef EVENT_LOG
+static void SimpleBLEBroadcaster_updateLog(void);
+static void SimpleBLEBroadcaster_maintLogReadCB(void);
+#endif
+static void SimpleBLEBroadcaster_maintConfigChangeCB(void);
+#endif
+static uint16_t advRand(void);
+static uint16_t advDithered(uint32_t advInt);
+static uint16_t SimpleBLEBroadcaster_timeBase(void);
+static void SimpleBLEBroadcaster_ledPlay(uint8_t pattern);
+#ifdef BEACON_WRISTBAND
+static void SimpleBLEBroadcaster_raiseAlarm(void);
+#endif
+#ifdef ACCEL_FALL_DETECT
+static void SimpleBLEBroadcaster_accelBatchHandler(void);
+static void SimpleBLEBroadcaster_accelMotionHandler(bool moving);
+static void SimpleBLEBroadcaster_processAccel(void);
+static void SimpleBLEBroadcaster_processMotion(bool moving);
+#endif
+
+#ifdef SBB_COMMANDS
+static void SimpleBLEBroadcaster_setState(uint8_t state);
+static void SimpleBLEBroadcaster_processCommand(const uint8_t *pFrame, uint8_t len);
+#endif
+#ifdef SBB_SCAN
+static bool SimpleBLEBroadcaster_scanWanted(void);
+static void SimpleBLEBroadcaster_processGapMsg(gapEventHdr_t *pMsg);
+#endif
+#ifdef ALARM_RELAY
+static void SimpleBLEBroadcaster_relayAlarm(uint8_t hops, const uint8_t *pSrc,
+                                            const uint8_t *pStatus);
+#endif
+static void SimpleBLEBroadcaster_measureBattery(void);
+#ifdef POWER_MEASURE
+static void SimpleBLEBroadcaster_pmWakeup(uint8_t src);
+#ifdef MAINTENANCE_WINDOW
+static uint8_t SimpleBLEBroadcaster_pmReport(uint8_t *pBuf);
+#endif
+#endif
+
+static void BatteryMeasureTimingHandler(UArg a0)
 {
-	PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_OFF);
+    PM_WAKEUP(PM_SRC_BATTERY);
+
+    SimpleBLEBroadcaster_measureBattery();
+
+    // Battery history
+    if (++battHistoryDivider >= BATT_HISTORY_PERIODS)
+    {
+        battHistoryDivider = 0;
+        battHistory[battHistoryIdx] = batt;
+        battHistoryIdx = (battHistoryIdx + 1) % BATT_HISTORY_LEN;
+        if (battHistoryCount < BATT_HISTORY_LEN) battHistoryCount++;
+    }
+
+#ifdef MAINTENANCE_WINDOW
+    // Scheduled maintenance window
+    if (++maintScheduleCount >= MAINT_SCHEDULE_PERIODS)
+    {
+        maintScheduleCount = 0;
+        SimpleBLEBroadcaster_enqueueMsg(SBB_MAINT_OPEN_EVT, 0);
+    }
+#endif
 }
 
-static void BatteryMeasureTimingHandler(UArg a0)
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_measureBattery
+ *
+ * @brief   Read battery voltage and temperature from the battery monitor.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_measureBattery(void)
 {
     // Battery monitor (bit 10:8 - integer, but 7:0 fraction)
     uint32_t batt_raw = AONBatMonBatteryVoltageGet();
@@ -314,11 +1026,20 @@ static void BatteryMeasureTimingHandler(UArg a0)
 
     // Compose battery
     batt = intPart | decPart;
+
+    // Battery voltage and temperature for the TLM slot
+    battMv   = (uint16_t)((batt_raw * 1000) >> 8);
+    battTemp = (int8_t)AONBatMonTemperatureGetDegC();
+
+    // Telemetry slot recomposed in the next advertising event
+    advTelemetryDirty = true;
 }
 
 
 static void longkeyTimingHandler(UArg a0)
 {
+    PM_WAKEUP(PM_SRC_KEY_TIMER);
+
     keyTimeoutLong = true;
     /*
     sbbEvt_t *pMsg;
@@ -337,6 +1058,8 @@ static void longkeyTimingHandler(UArg a0)
 
 static void shortkeyTimingHandler(UArg a0)
 {
+    PM_WAKEUP(PM_SRC_KEY_TIMER);
+
     keyTimeoutShort = true;
     /*
     sbbEvt_t *pMsg;
@@ -353,6 +1076,38 @@ static void shortkeyTimingHandler(UArg a0)
     */
 }
 
+#ifdef MAINTENANCE_WINDOW
+static void maintkeyTimingHandler(UArg a0)
+{
+    PM_WAKEUP(PM_SRC_KEY_TIMER);
+
+    keyTimeoutMaint = true;
+}
+
+static void MaintWindowTimingHandler(UArg a0)
+{
+    PM_WAKEUP(PM_SRC_MAINT);
+
+    SimpleBLEBroadcaster_enqueueMsg(SBB_MAINT_CLOSE_EVT, 0);
+}
+#endif
+
+static void AdvStartTimingHandler(UArg a0)
+{
+    PM_WAKEUP(PM_SRC_ADV_START);
+
+    SimpleBLEBroadcaster_enqueueMsg(SBB_ADV_START_EVT, 0);
+}
+
+#ifdef POWER_SAVING
+static void ShutdownTimingHandler(UArg a0)
+{
+    PM_WAKEUP(PM_SRC_SHUTDOWN);
+
+    SimpleBLEBroadcaster_enqueueMsg(SBB_SHUTDOWN_EVT, 0);
+}
+#endif
+
 /*********************************************************************
  * PROFILE CALLBACKS
  */
@@ -362,6 +1117,19 @@ static gapRolesCBs_t simpleBLEBroadcaster_BroadcasterCBs =
   SimpleBLEBroadcaster_stateChangeCB   // Profile State Change Callbacks
 };
 
+#ifdef MAINTENANCE_WINDOW
+// Maintenance Service Callbacks
+static maintServiceCBs_t simpleBLEBroadcaster_maintServiceCBs =
+{
+  SimpleBLEBroadcaster_maintConfigChangeCB, // Configuration written
+#ifdef EVENT_LOG
+  SimpleBLEBroadcaster_maintLogReadCB       // Event log read out
+#else
+  NULL
+#endif
+};
+#endif
+
 
 /*********************************************************************
  * PUBLIC FUNCTIONS
@@ -412,6 +1180,40 @@ static void SimpleBLEBroadcaster_init(void)
   // so that the application can send and receive messages.
   ICall_registerApp(&selfEntity, &sem);
 
+#ifdef POWER_SAVING
+  // Warehouse shutdown left by a KEY_1 press: fast resume, no greeting
+  keyWakeHeld = (SysCtrlResetSourceGet() == RSTSRC_WAKEUP_FROM_SHUTDOWN);
+#endif
+
+  // Seed the random generator with the factory BD address (the stack
+  // reports it only at GAPROLE_STARTED, after the first advertising start)
+  // and the RTC, then draw the per device interval offset
+  {
+    uint32_t mac[2];
+
+    mac[0] = HWREG(FCFG1_BASE + FCFG1_O_MAC_BLE_0);
+    mac[1] = HWREG(FCFG1_BASE + FCFG1_O_MAC_BLE_1);
+
+    for (uint8_t i = 0; i < B_ADDR_LEN; i++)
+    {
+      advRandState = (advRandState << 5) ^ (advRandState >> 27) ^
+                     (uint8_t)(mac[i / 4] >> (8 * (i % 4)));
+    }
+    advRandState ^= AONRTCFractionGet();
+
+    if (advRandState == 0)
+    {
+      advRandState = 0x2545F491;
+    }
+
+    advDither = advRand() % ADV_DITHER_SPAN;
+  }
+
+  // Delayed advertising start timer constructor (timeout set when started)
+  Util_constructClock(&advStartTimer,
+                      AdvStartTimingHandler,
+                      1, 0, false, 0);
+
   // Hard code the DB Address till CC2650 board gets its own IEEE address
   //uint8 bdAddress[B_ADDR_LEN] = { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33 };
   //HCI_EXT_SetBDADDRCmd(bdAddress);
@@ -422,6 +1224,7 @@ static void SimpleBLEBroadcaster_init(void)
 
   // Create an RTOS queue for message from profile to be sent to app.
   appMsgQueue = Util_constructQueue(&appMsg);
+  alarmMsgQueue = Util_constructQueue(&alarmMsg);
 
   // Open LCD
   dispHandle = Display_open(Display_Type_LCD, NULL);
@@ -429,6 +1232,56 @@ static void SimpleBLEBroadcaster_init(void)
   // Register Key Call Back
   Board_initKeys(SimpleBLEBroadcaster_keyChangeHandler);
 
+#ifdef ACCEL_FALL_DETECT
+  // Fall detection, the beacon keeps working on the key alone if the
+  // sensor does not answer
+  FallDetect_init(&fallDetect);
+  Activity_init(&activity);
+  if (!Board_initAccel(SimpleBLEBroadcaster_accelBatchHandler,
+                       SimpleBLEBroadcaster_accelMotionHandler))
+  {
+    LOG_EVENT0(LOG_ACCEL_MISSING);
+  }
+#endif
+
+  // Fetch device name and serial number, variant defaults otherwise
+  if ((osal_snv_read(SNV_ID_DEVNAME, sizeof(devName), &devName) != SUCCESS) ||
+      (devName.len == 0) || (devName.len > SCAN_RSP_NAME_MAX_LEN))
+  {
+      devName.len = sizeof(DEFAULT_DEVICE_NAME) - 1;
+      memcpy(devName.name, DEFAULT_DEVICE_NAME, devName.len);
+  }
+
+  // Without a factory serial number the BD address is used (GAPROLE_STARTED)
+  osal_snv_read(SNV_ID_SERIAL, sizeof(devSerial), devSerial);
+
+  // Fetch runtime configuration, defaults otherwise
+  {
+      sbbConfig_t config;
+
+      if ((osal_snv_read(SNV_ID_APPCONFIG, sizeof(config), &config) == SUCCESS) &&
+          (config.advPeriod >= 1) && (config.advPeriod <= 10) &&
+          (config.keepalivePeriod >= 1) && (config.keepalivePeriod <= 10) &&
+          (config.ledEnable <= 1) && (config.slotRatio <= 20) &&
+          ((config.stillTime == 0) ||
+           ((config.stillTime >= 10) && (config.stillTime <= 1300))) &&
+          (config.relayEnable <= 1))
+      {
+          appConfig = config;
+      }
+  }
+
+#ifdef ACCEL_FALL_DETECT
+  Board_accelSetStillTime(appConfig.stillTime);
+#endif
+
+#ifdef SBB_COMMANDS
+  // Command beacon key (provisioned at factory, commands and maintenance
+  // configuration ignored without it) and last accepted sequence number
+  cmdKeyValid = (osal_snv_read(SNV_ID_CMDKEY, sizeof(cmdKey), cmdKey) == SUCCESS);
+  osal_snv_read(SNV_ID_CMDSEQ, sizeof(cmdSeq), &cmdSeq);
+#endif
+
   // Setup the GAP Broadcaster Role Profile
   {
     // For all hardware platforms, device starts advertising upon initialization
@@ -439,11 +1292,7 @@ static void SimpleBLEBroadcaster_init(void)
     // until the enabler is set back to TRUE
     uint16_t gapRole_AdvertOffTime = 0;
 
-/*#ifndef BEACON_FEATURE
-    uint8_t advType = GAP_ADTYPE_ADV_SCAN_IND; // use scannable undirected adv
-#else*/
-    uint8_t advType = GAP_ADTYPE_ADV_NONCONN_IND; // use non-connectable adv
-//#endif // !BEACON_FEATURE
+    uint8_t advType = ADV_EVENT_TYPE;
 
     // Set the GAP Role Parameters
     GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
@@ -451,16 +1300,56 @@ static void SimpleBLEBroadcaster_init(void)
     GAPRole_SetParameter(GAPROLE_ADVERT_OFF_TIME, sizeof(uint16_t),
                          &gapRole_AdvertOffTime);
 
-    GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, sizeof (scanRspData),
-                         scanRspData);
+    SimpleBLEBroadcaster_updateScanRsp();
     GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
 
     GAPRole_SetParameter(GAPROLE_ADV_EVENT_TYPE, sizeof(uint8_t), &advType);
+
+#ifdef MAINTENANCE_WINDOW
+    // Connection parameters requested in the maintenance window
+    uint8_t  enableUpdateRequest = GAPROLE_LINK_PARAM_UPDATE_INITIATE_BOTH_PARAMS;
+    uint16_t desiredMinInterval  = MAINT_CONN_INTERVAL_MIN;
+    uint16_t desiredMaxInterval  = MAINT_CONN_INTERVAL_MAX;
+    uint16_t desiredSlaveLatency = 0;
+    uint16_t desiredConnTimeout  = MAINT_CONN_TIMEOUT;
+
+    GAPRole_SetParameter(GAPROLE_PARAM_UPDATE_ENABLE, sizeof(uint8_t),
+                         &enableUpdateRequest);
+    GAPRole_SetParameter(GAPROLE_MIN_CONN_INTERVAL, sizeof(uint16_t),
+                         &desiredMinInterval);
+    GAPRole_SetParameter(GAPROLE_MAX_CONN_INTERVAL, sizeof(uint16_t),
+                         &desiredMaxInterval);
+    GAPRole_SetParameter(GAPROLE_SLAVE_LATENCY, sizeof(uint16_t),
+                         &desiredSlaveLatency);
+    GAPRole_SetParameter(GAPROLE_TIMEOUT_MULTIPLIER, sizeof(uint16_t),
+                         &desiredConnTimeout);
+#endif
+  }
+
+#ifdef MAINTENANCE_WINDOW
+  // Maintenance GATT database
+  {
+    uint8_t attDeviceName[GAP_DEVICE_NAME_LEN] = { 0 };
+
+    memcpy(attDeviceName, devName.name, devName.len);
+    GGS_SetParameter(GGS_DEVICE_NAME_ATT, GAP_DEVICE_NAME_LEN, attDeviceName);
+
+    GGS_AddService(GATT_ALL_SERVICES);           // GAP
+    GATTServApp_AddService(GATT_ALL_SERVICES);   // GATT attributes
+    MaintService_AddService();                   // Maintenance service
+    MaintService_RegisterAppCBs(&simpleBLEBroadcaster_maintServiceCBs);
+
+    // Long configuration writes
+    GATTServApp_SetParamValue(GATT_PARAM_NUM_PREPARE_WRITES, MAINT_PREPARE_WRITES);
+
+    // Largest link layer packets, so a bulk read fits a connection event
+    HCI_LE_WriteSuggestedDefaultDataLenCmd(251, 2120);
   }
+#endif
 
   // Set advertising interval
   {
-    uint16_t advInt = DEFAULT_ADVERTISING_INTERVAL;
+    uint16_t advInt = appConfig.advPeriod * 1600;
 
     GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MIN, advInt);
     GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MAX, advInt);
@@ -504,14 +1393,22 @@ static void SimpleBLEBroadcaster_init(void)
           setAdvIntData(ADV_DEFAULT);
   }
 
-  // First hello world auto start led
-  ledCtrlHandle = PIN_open(&ledCtrlState, ledCtrlCfg);
-  PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-  Util_constructClock(&initialLEDTimer,
-                      InitialLEDTimingHandler,
-                      HELLOWORLD_TIMER, 0, true, 0);
+  // First hello world auto start led, a short flash on resume
+  Board_initLed(ledPatterns, LED_PATTERN_COUNT, ledOnTime);
+#ifdef POWER_SAVING
+  if (keyWakeHeld)
+  {
+    SimpleBLEBroadcaster_ledPlay(LED_PATTERN_KEEPALIVE);
+  }
+  else
+#endif
+  {
+    SimpleBLEBroadcaster_ledPlay(LED_PATTERN_HELLO);
+  }
 
-  // Battery measure clock
+  // Battery measure clock, the battery monitor is enabled here so the
+  // first measure at GAPROLE_STARTED is valid
+  AONBatMonEnable();
   Util_constructClock(&batteryMeasureTimer,
                       BatteryMeasureTimingHandler,
                       BATTERY_PERIOD, BATTERY_PERIOD, true, 0);
@@ -526,7 +1423,27 @@ static void SimpleBLEBroadcaster_init(void)
                       shortkeyTimingHandler,
                       SHORTKEY_TIMER, 0, false, 0);
 
-  Display_print0(dispHandle, 0, 0, "BLE Broadcaster");
+#ifdef MAINTENANCE_WINDOW
+  // Maintkey timer constructor
+  Util_constructClock(&maintkeyTimer,
+                      maintkeyTimingHandler,
+                      MAINTKEY_TIMER, 0, false, 0);
+
+  // Maintenance window timer constructor
+  Util_constructClock(&maintWindowTimer,
+                      MaintWindowTimingHandler,
+                      MAINT_WINDOW_DURATION, 0, false, 0);
+#endif
+
+#ifdef POWER_SAVING
+  // Warehouse shutdown timer constructor, started for the stock left in
+  // warehouse after a burning procedure
+  Util_constructClock(&shutdownTimer,
+                      ShutdownTimingHandler,
+                      SHUTDOWN_DELAY, 0, (appState == STATE_WAREHOUSE), 0);
+#endif
+
+  LOG_EVENT2(LOG_BOOT, FIRMWARE_VERSION, SysCtrlResetSourceGet());
 
   HCI_EXT_AdvEventNoticeCmd(selfEntity, SBB_ADV_EVT);
 }
@@ -560,45 +1477,111 @@ static void SimpleBLEBroadcaster_taskFxn(UArg a0, UArg a1)
 
     if (errno == ICALL_ERRNO_SUCCESS)
     {
-      ICall_EntityID dest;
-      ICall_ServiceEnum src;
-      ICall_HciExtEvt *pMsg = NULL;
+      uint8_t batch = 0;
+
+#ifdef POWER_MEASURE
+      // Active time starts when the task is woken up
+      tickStart = Clock_getTicks();
+#endif
 
-      if (ICall_fetchServiceMsg(&src, &dest,
-                                (void **)&pMsg) == ICALL_ERRNO_SUCCESS)
+      // Drain every ready source in this wake (the semaphore counts left
+      // behind only cost empty passes), alarm messages first so an alarm
+      // never waits behind stack or housekeeping messages
+      for (;;)
       {
-        if ((src == ICALL_SERVICE_CLASS_BLE) && (dest == selfEntity))
+        ICall_EntityID dest;
+        ICall_ServiceEnum src;
+        ICall_HciExtEvt *pMsg = NULL;
+
+        if (!Queue_empty(alarmMsgQueue))
         {
-          // Process inter-task message
-          SimpleBLEBroadcaster_processStackMsg((ICall_Hdr *)pMsg);
+          SimpleBLEBroadcaster_dispatchAppMsg(alarmMsgQueue);
         }
 
-        if (pMsg)
+        else if (ICall_fetchServiceMsg(&src, &dest,
+                                       (void **)&pMsg) == ICALL_ERRNO_SUCCESS)
         {
-          ICall_freeMsg(pMsg);
+          if ((src == ICALL_SERVICE_CLASS_BLE) && (dest == selfEntity))
+          {
+            // Process inter-task message
+            SimpleBLEBroadcaster_processStackMsg((ICall_Hdr *)pMsg);
+          }
+
+          if (pMsg)
+          {
+            ICall_freeMsg(pMsg);
+          }
         }
-      }
 
-      // If RTOS queue is not empty, process app message.
-      while (!Queue_empty(appMsgQueue))
-      {
-        sbbEvt_t *pMsg = (sbbEvt_t *)Util_dequeueMsg(appMsgQueue);
-        if (pMsg)
+        else if (!Queue_empty(appMsgQueue))
         {
-          // Process message.
-          SimpleBLEBroadcaster_processAppMsg(pMsg);
+          SimpleBLEBroadcaster_dispatchAppMsg(appMsgQueue);
+        }
 
-          // Free the space from the message.
-          ICall_free(pMsg);
+        else
+        {
+          break;
         }
+
+        batch++;
+      }
+
+#ifdef POWER_MEASURE
+      if (batch > 0)
+      {
+        pmDispatchWakes++;
+        pmDispatchMsgs += batch;
+        pmBatchMax = MAX(pmBatchMax, batch);
       }
+
+      pmActiveTicks += Clock_getTicks() - tickStart;
+#else
+      (void)batch;
+#endif
     }
   }
 }
 
 
 /*********************************************************************
- * @fn      SimpleBLEBroadcaster_processStackMsg
+ * @fn      SimpleBLEBroadcaster_dispatchAppMsg
+ *
+ * @brief   Dequeue, process and free one application message.
+ *
+ * @param   msgQueue - alarmMsgQueue or appMsgQueue
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_dispatchAppMsg(Queue_Handle msgQueue)
+{
+  sbbEvt_t *pMsg = (sbbEvt_t *)Util_dequeueMsg(msgQueue);
+
+  if (pMsg)
+  {
+#ifdef POWER_MEASURE
+    uint32_t latency = Clock_getTicks() - pMsg->ticks;
+
+    if (msgQueue == alarmMsgQueue)
+    {
+      pmAlarmLatencyMax = MAX(pmAlarmLatencyMax, latency);
+    }
+    else
+    {
+      pmAppLatencyMax = MAX(pmAppLatencyMax, latency);
+    }
+#endif
+
+    // Process message.
+    SimpleBLEBroadcaster_processAppMsg(pMsg);
+
+    // Free the space from the message.
+    ICall_free(pMsg);
+  }
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_processStackMsg
  *
  * @brief   Process an incoming stack message.
  *
@@ -614,20 +1597,59 @@ static void SimpleBLEBroadcaster_processStackMsg(ICall_Hdr *pMsg)
 	{
 		if (pEvt->event_flag & SBB_ADV_EVT)
 		{
-			if(alarmCounter>0)
+			PM_WAKEUP(PM_SRC_ADV);
+
+			// Led steps waiting on the advertising event, the dense
+			// alarm burst is not flashed
+			if(alarmBurstInterval==0)
+			{
+				Board_ledAdvEvent();
+			}
+
+			if(alarmBurstInterval>0)
 			{
+				// Burst phase: dense jittered alarm advertising decaying
+				// geometrically to ALARM_ADVERTISING_INTERVAL
 				advertData[6]=0x80;
-				alarmCounter--;
 
-				PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-				Util_restartClock(&initialLEDTimer, LED_BLINK_DURATION_MS);
+				// The burst is part of the alarm window, one steady
+				// event less per ALARM_ADVERTISING_INTERVAL of burst
+				alarmBurstTime += alarmBurstInterval;
+				if((alarmBurstTime >= ALARM_ADVERTISING_INTERVAL) && (alarmCounter > 1))
+				{
+				    alarmBurstTime -= ALARM_ADVERTISING_INTERVAL;
+				    alarmCounter--;
+				}
+
+				if(++alarmBurstEvents >= ALARM_BURST_EVENTS_PER_STEP)
+				{
+				    alarmBurstEvents = 0;
+				    alarmBurstInterval <<= 1;
+
+				    if(alarmBurstInterval >= ALARM_ADVERTISING_INTERVAL)
+				    {
+				        // Steady alarm rate, alarmCounter drains per event
+				        alarmBurstInterval = 0;
+				        setAdvInterval(ALARM_ADVERTISING_INTERVAL);
+				    }
+				    else
+				    {
+				        setAdvInterval(alarmBurstInterval + advRand() % ALARM_BURST_JITTER);
+				    }
+				}
+			}
+			else if(alarmCounter>0)
+			{
+				advertData[6]=0x80;
+				alarmCounter--;
 
 				if(alarmCounter==0)
 				{
-				    setAdvIntData(ADV_DEFAULT);
+				    // Normal (or still) advertising
+				    SimpleBLEBroadcaster_restoreAdv();
 
                     advertData[6]=0x00;
-                    PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_OFF);
+                    Board_ledStop();
 				}
 			}
 			else
@@ -635,14 +1657,360 @@ static void SimpleBLEBroadcaster_processStackMsg(ICall_Hdr *pMsg)
 				advertData[6]=0x00;
 			}
 
+#ifdef AUTOMATE_CHECKS
+			// alarmCounter always drains
+			if (alarmCounter > 0 || alarmBurstInterval > 0)
+			{
+				SBB_CHECK(++alarmDrainEvents <= ALARM_DRAIN_MAX_EVENTS);
+			}
+			SBB_CHECK(alarmCounter <= EVENTOS_EN_UN_MINUTO);
+#endif
+
+            // Battery history summary, scan response refreshed on change
+            if ((batt != 0) && (battMin == 0 || batt < battMin))
+            {
+                battMin = batt;
+                scanRspDirty = true;
+            }
+            if (batt > battMax)
+            {
+                battMax = batt;
+                scanRspDirty = true;
+            }
+            if (scanRspDirty)
+            {
+                SimpleBLEBroadcaster_updateScanRsp();
+            }
+
             // Compose and update advertising data
             advertData[6] |= batt; // battery
-            advertData[7]++;       // counter
 
-			GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
+            // Time base: the next packet goes out one interval from now,
+            // an alarm keeps the time it was raised
+            {
+                uint16_t timeStamp = (advertData[6] & 0x80)? alarmTime :
+                    SimpleBLEBroadcaster_timeBase() + (advIntervalActive + 100) / 200;
+
+                advertData[8] = LO_UINT16(timeStamp);
+                advertData[9] = HI_UINT16(timeStamp);
+            }
+
+            // New battery measure
+            if (advTelemetryDirty)
+            {
+                SimpleBLEBroadcaster_updateBattTier();
+                SimpleBLEBroadcaster_updateTelemetrySlot();
+
+                // Gateways gone silent, back to full tier power
+                if ((txPowerReduction > 0) && (++txFeedbackAge >= TX_FEEDBACK_TIMEOUT))
+                {
+                    txPowerReduction = 0;
+                    SimpleBLEBroadcaster_applyTxPower();
+                }
+            }
+
+            // Degraded tier flag
+            if (battTier > 0)
+            {
+                advertData[6] |= 0x40;
+            }
+
+            advCount++;
+
+            // Next slot, all slots precomposed
+            {
+                uint8_t slot = SimpleBLEBroadcaster_nextAdvSlot();
+
+                if (slot == ADV_SLOT_STATUS)
+                {
+                    advertData[7]++;   // counter
+                }
+                else if (slot == ADV_SLOT_TLM)
+                {
+                    SimpleBLEBroadcaster_updateTlmSlot();
+                }
+
+                GAPRole_SetParameter(GAPROLE_ADVERT_DATA, advSlots[slot].len,
+                                     advSlots[slot].pData);
+            }
+
+#ifdef SBB_SCAN
+            // Listen for gateway commands and alarms to relay right after
+            // this advertising event, never while an alarm is being advertised
+            if (SimpleBLEBroadcaster_scanWanted() && !scanning &&
+                (alarmCounter == 0) && (alarmBurstInterval == 0) &&
+                ((scanElapsed += advIntervalActive) >= SCAN_PERIOD))
+            {
+                gapDevDiscReq_t discReq;
+
+                // Passive scan window, timing set per window as the relay
+                // setting may have changed since the last one
+                GAP_SetParamValue(TGAP_GEN_DISC_SCAN, SCAN_DURATION);
+                GAP_SetParamValue(TGAP_GEN_DISC_SCAN_INT, SCAN_WINDOW);
+                GAP_SetParamValue(TGAP_GEN_DISC_SCAN_WIND, SCAN_WINDOW);
+
+                discReq.taskID     = ICall_getLocalMsgEntityId(ICALL_SERVICE_CLASS_BLE_MSG,
+                                                               selfEntity);
+                discReq.mode       = DEVDISC_MODE_ALL;
+                discReq.activeScan = FALSE;
+                discReq.whiteList  = FALSE;
+
+                if (GAP_DeviceDiscoveryRequest(&discReq) == SUCCESS)
+                {
+                    scanning  = true;
+                    scanElapsed = 0;
+                }
+            }
+#endif
 		}
 	}
+#ifdef SBB_SCAN
+	else if (pMsg->event == GAP_MSG_EVENT)
+	{
+		PM_WAKEUP(PM_SRC_STACK);
+		SimpleBLEBroadcaster_processGapMsg((gapEventHdr_t *)pMsg);
+	}
+#endif
+}
+
+
+#ifdef SBB_SCAN
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_scanWanted
+ *
+ * @brief   Scan windows are only opened when something listens to them:
+ *          a provisioned command key or the alarm relay enabled.
+ *
+ * @param   none
+ *
+ * @return  true if scan windows are due
+ */
+static bool SimpleBLEBroadcaster_scanWanted(void)
+{
+#ifdef COMMAND_SCAN
+  if (cmdKeyValid)
+  {
+    return true;
+  }
+#endif
+#ifdef ALARM_RELAY
+  if (appConfig.relayEnable)
+  {
+    return true;
+  }
+#endif
+  return false;
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_processGapMsg
+ *
+ * @brief   Process GAP discovery events of the scan window.
+ *
+ * @param   pMsg - GAP event message
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_processGapMsg(gapEventHdr_t *pMsg)
+{
+  switch (pMsg->opcode)
+  {
+    case GAP_DEVICE_INFO_EVENT:
+      {
+        gapDeviceInfoEvent_t *pInfo = (gapDeviceInfoEvent_t *)pMsg;
+        uint8_t i = 0;
+
+        // Look for command, status and relay frames in the advertising data
+        while (i + 1 < pInfo->dataLen)
+        {
+          uint8_t adLen = pInfo->pEvtData[i];
+          const uint8_t *pFrame = &pInfo->pEvtData[i + 2];
+
+          if ((adLen == 0) || (i + 1 + adLen > pInfo->dataLen))
+          {
+            break;
+          }
+
+          if ((pInfo->pEvtData[i + 1] == GAP_ADTYPE_MANUFACTURER_SPECIFIC) &&
+              (adLen > 1))
+          {
+            switch (pFrame[0])
+            {
+#ifdef COMMAND_SCAN
+              case FRAME_COMMAND:
+                SimpleBLEBroadcaster_processCommand(pFrame, adLen - 1);
+                break;
+#endif
+
+#ifdef ALARM_RELAY
+              // Alarm heard directly, first hop
+              case FRAME_STATUS:
+                if ((adLen >= 6) && (pFrame[1] & 0x80))
+                {
+                  SimpleBLEBroadcaster_relayAlarm(1, pInfo->addr, &pFrame[1]);
+                }
+                break;
+
+              // Alarm heard from another relay
+              case FRAME_RELAY:
+                if ((adLen >= 13) && (pFrame[1] < RELAY_MAX_HOPS))
+                {
+                  SimpleBLEBroadcaster_relayAlarm(pFrame[1] + 1, &pFrame[2], &pFrame[8]);
+                }
+                break;
+#endif
+
+              default:
+                break;
+            }
+          }
+
+          i += adLen + 1;
+        }
+      }
+      break;
+
+    case GAP_DEVICE_DISCOVERY_EVENT:
+      // Scan window closed
+      scanning = false;
+      break;
+
+    default:
+      break;
+  }
+}
+#endif // SBB_SCAN
+
+#ifdef SBB_COMMANDS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_processCommand
+ *
+ * @brief   Authenticate and run a gateway command frame, from a command
+ *          beacon or the maintenance window. The frame is signed with a
+ *          truncated SipHash-2-4 and must carry a sequence number newer
+ *          than the last accepted one (no replays).
+ *
+ * @param   pFrame - command frame, starting with FRAME_COMMAND
+ * @param   len    - frame length
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_processCommand(const uint8_t *pFrame, uint8_t len)
+{
+  uint16_t seq;
+  uint32_t target;
+  uint64_t mac;
+
+  if ((len < CMD_HDR_LEN + CMD_MAC_LEN) || (pFrame[0] != FRAME_COMMAND) ||
+      !cmdKeyValid)
+  {
+    return;
+  }
+
+  seq    = BUILD_UINT16(pFrame[1], pFrame[2]);
+  target = BUILD_UINT32(pFrame[3], pFrame[4], pFrame[5], pFrame[6]);
+
+  // Addressed to this device, and not already applied
+  if ((target != CMD_TARGET_ALL) &&
+      (target != BUILD_UINT32(devSerial[0], devSerial[1], devSerial[2], devSerial[3])))
+  {
+    return;
+  }
+
+  if ((int16_t)(seq - cmdSeq) <= 0)
+  {
+    return;
+  }
+
+  // Signature over the whole frame but the mac itself
+  mac = SipHash_24(cmdKey, pFrame, len - CMD_MAC_LEN);
+  if ((pFrame[len - 4] != BREAK_UINT32(mac, 0)) ||
+      (pFrame[len - 3] != BREAK_UINT32(mac, 1)) ||
+      (pFrame[len - 2] != BREAK_UINT32(mac, 2)) ||
+      (pFrame[len - 1] != BREAK_UINT32(mac, 3)))
+  {
+    return;
+  }
+
+  cmdSeq = seq;
+  osal_snv_write(SNV_ID_CMDSEQ, sizeof(cmdSeq), &cmdSeq);
+
+  switch (pFrame[7])
+  {
+    case CMD_CONFIG:
+      SimpleBLEBroadcaster_applyConfig(&pFrame[CMD_HDR_LEN],
+                                       len - CMD_HDR_LEN - CMD_MAC_LEN);
+      break;
+
+    case CMD_STATE:
+      if (len == CMD_HDR_LEN + 1 + CMD_MAC_LEN)
+      {
+        SimpleBLEBroadcaster_setState(pFrame[CMD_HDR_LEN]);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+#endif // SBB_COMMANDS
+
+#ifdef ALARM_RELAY
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_relayAlarm
+ *
+ * @brief   Relay an alarm heard from another wristband. One source is
+ *          relayed at a time, for RELAY_EVENTS advertising events since
+ *          its last new frame. Frames whose counter is not newer than the
+ *          relayed one (same event heard again or through a longer path)
+ *          are dropped.
+ *
+ * @param   hops    - hop count, 1 when heard from the source itself
+ * @param   pSrc    - source device address
+ * @param   pStatus - source status, counter and time base (4 bytes)
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_relayAlarm(uint8_t hops, const uint8_t *pSrc,
+                                            const uint8_t *pStatus)
+{
+  uint8 ownAddress[B_ADDR_LEN];
+
+  if (!appConfig.relayEnable)
+  {
+    return;
+  }
+
+  // Our own alarm relayed back
+  GAPRole_GetParameter(GAPROLE_BD_ADDR, ownAddress);
+  if (memcmp(pSrc, ownAddress, B_ADDR_LEN) == 0)
+  {
+    return;
+  }
+
+  if (relayEvents > 0)
+  {
+    // Busy with another source
+    if (memcmp(pSrc, &advRelay[7], B_ADDR_LEN) != 0)
+    {
+      return;
+    }
+
+    // Duplicate
+    if ((int8_t)(pStatus[1] - advRelay[14]) <= 0)
+    {
+      return;
+    }
+  }
+
+  advRelay[6] = hops;
+  memcpy(&advRelay[7], pSrc, B_ADDR_LEN);
+  memcpy(&advRelay[13], pStatus, 4);
+
+  relayEvents = RELAY_EVENTS;
 }
+#endif // ALARM_RELAY
 
 
 /*********************************************************************
@@ -656,18 +2024,105 @@ static void SimpleBLEBroadcaster_processStackMsg(ICall_Hdr *pMsg)
  */
 void SimpleBLEBroadcaster_keyChangeHandler(uint8 keys)
 {
-  sbbEvt_t *pMsg;
+  PM_WAKEUP(PM_SRC_KEY);
 
-  // Create dynamic pointer to message.
-  if ((pMsg = ICall_malloc(sizeof(sbbEvt_t))))
+  SimpleBLEBroadcaster_enqueueMsg(SBB_KEY_CHANGE_EVT, keys);
+}
+
+#ifdef ACCEL_FALL_DETECT
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_accelBatchHandler
+ *
+ * @brief   Accelerometer batch ready (FIFO watermark) handler
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_accelBatchHandler(void)
+{
+  PM_WAKEUP(PM_SRC_ACCEL);
+
+  SimpleBLEBroadcaster_enqueueMsg(SBB_ACCEL_EVT, 0);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_accelMotionHandler
+ *
+ * @brief   Accelerometer motion change (awake status) handler
+ *
+ * @param   moving - true when motion started, false after stillness
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_accelMotionHandler(bool moving)
+{
+  PM_WAKEUP(PM_SRC_ACCEL);
+
+  SimpleBLEBroadcaster_enqueueMsg(SBB_MOTION_EVT, moving);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_processAccel
+ *
+ * @brief   Drain a batch from the accelerometer FIFO and run it through
+ *          the activity estimator and the fall detector. A fall raises
+ *          the same alarm as the key, except in warehouse where the
+ *          beacon is not worn.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_processAccel(void)
+{
+  uint16_t n = Board_readAccel(accelBatch);
+
+  // Counters reach the telemetry slot with the next battery measure
+  Activity_process(&activity, accelBatch, n);
+
+  if (!FallDetect_process(&fallDetect, accelBatch, n) ||
+      (appState == STATE_WAREHOUSE))
+  {
+    return;
+  }
+
+#ifdef BEACON_WRISTBAND
+  SimpleBLEBroadcaster_raiseAlarm();
+  appState = STATE_ADV_NORMAL;
+#endif
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_processMotion
+ *
+ * @brief   Motion change: FIFO batches are only delivered while moving,
+ *          normal advertising slows down while still.
+ *
+ * @param   moving - true when motion started, false after stillness
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_processMotion(bool moving)
+{
+  accelMoving = moving;
+  Board_accelEnableBatches(moving);
+
+#ifdef MAINTENANCE_WINDOW
+  // The window restores the advertising when it closes
+  if (maintWindowOpen)
   {
-    pMsg->hdr.event = SBB_KEY_CHANGE_EVT;
-	pMsg->hdr.state = keys;
+    return;
+  }
+#endif
 
-	// Enqueue the message.
-	Util_enqueueMsg(appMsgQueue, sem, (uint8*)pMsg);
+  if (((appState == STATE_ADV_NORMAL) && !moving) ||
+      ((appState == STATE_ADV_STILL) && moving))
+  {
+    SimpleBLEBroadcaster_restoreAdv();
   }
 }
+#endif // ACCEL_FALL_DETECT
 
 
 /*********************************************************************
@@ -694,15 +2149,8 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
       if (key)
       {
 #ifdef BEACON_WRISTBAND
-          // Set advertising data
-          setAdvIntData(ADV_ALARM);
-
-          // Set alarm counter
-          alarmCounter = EVENTOS_EN_UN_MINUTO;
-
-          // Launch alarm led
-          PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-          Util_restartClock(&initialLEDTimer, LED_BLINK_DURATION_MS);
+          // Alarm advertising, counter and led
+          SimpleBLEBroadcaster_raiseAlarm();
 
           // Next state
 //          appStateNew = STATE_ADV_ALARM;
@@ -714,7 +2162,7 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
           setAdvIntData(ADV_DEFAULT);
 
           // Led on
-          PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
+          SimpleBLEBroadcaster_ledPlay(LED_PATTERN_KEY);
 
           // Next state
           appStateNew = STATE_ADV_NORMAL;
@@ -725,12 +2173,35 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
       // KEY_1 not pressed (falling edge interruption handled)
       else
       {
+          // Key timers may be running if the state changed while the
+          // key was held (remote state change), drop them
+          Util_stopClock(&shortkeyTimer);
+          Util_stopClock(&longkeyTimer);
+#ifdef MAINTENANCE_WINDOW
+          Util_stopClock(&maintkeyTimer);
+#endif
+          keyTimeoutLong  = false;
+          keyTimeoutShort = false;
+#ifdef MAINTENANCE_WINDOW
+          keyTimeoutMaint = false;
+#endif
+
           // Next state
           appStateNew = appState;
       }
     }
     break;
 
+/// advertising still /////////////////////////////////// Beacon Automate //////
+    case STATE_ADV_STILL:
+
+        // The key resumes normal advertising at once and is then handled
+        // as in normal advertising
+        appState = STATE_ADV_NORMAL;
+        setAdvIntData(ADV_DEFAULT);
+
+        // Fall through
+
 /// advertising normal ////////////////////////////////// Beacon Automate //////
     case STATE_ADV_NORMAL:
 
@@ -741,10 +2212,13 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
             // Actions: 1.- restart shortkey timer
             Util_restartClock(&shortkeyTimer, SHORTKEY_TIMER);
             Util_restartClock(&longkeyTimer, LONGKEY_TIMER);
+#ifdef MAINTENANCE_WINDOW
+            Util_restartClock(&maintkeyTimer, MAINTKEY_TIMER);
+#endif
 
 #ifdef BEACON_KEYRINGUS
             // Led on
-            PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
+            SimpleBLEBroadcaster_ledPlay(LED_PATTERN_KEY);
 #endif
 
             // Next state
@@ -757,16 +2231,33 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
             // Stop all timers
             Util_stopClock(&shortkeyTimer);
             Util_stopClock(&longkeyTimer);
+#ifdef MAINTENANCE_WINDOW
+            Util_stopClock(&maintkeyTimer);
+#endif
 
             // Compute key_time flags
+#ifdef MAINTENANCE_WINDOW
+            if (keyTimeoutMaint)
+            {
+                // Open connectable maintenance window
+                SimpleBLEBroadcaster_openMaintWindow();
+
+                // Launch maintenance led
+                SimpleBLEBroadcaster_ledPlay(LED_PATTERN_MAINTENANCE);
+
+                // Next state
+                appStateNew = appState;
+            }
+
+            else
+#endif
             if (keyTimeoutLong)
             {
                 // Stop advertising
                 setAdvIntData(ADV_STOP);
 
                 // Launch keepalive led
-                PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-                Util_restartClock(&initialLEDTimer, LED_BLINK_DURATION_MS*40);
+                SimpleBLEBroadcaster_ledPlay(LED_PATTERN_WAREHOUSE);
 
                 // Next state
                 appStateNew = STATE_WAREHOUSE;
@@ -778,8 +2269,7 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
                 setAdvIntData(ADV_KEEPALIVE);
 
                 // Launch keepalive led
-                PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-                Util_restartClock(&initialLEDTimer, LED_BLINK_DURATION_MS*10);
+                SimpleBLEBroadcaster_ledPlay(LED_PATTERN_KEEPALIVE);
 
                 // Next state
                 appStateNew = STATE_ADV_KEEPALIVE;
@@ -789,15 +2279,8 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
             {
 
 #ifdef BEACON_WRISTBAND
-              // Set advertising data
-              setAdvIntData(ADV_ALARM);
-
-              // Set alarm counter
-              alarmCounter = EVENTOS_EN_UN_MINUTO;
-
-              // Launch alarm led
-              PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_ON);
-              Util_restartClock(&initialLEDTimer, LED_BLINK_DURATION_MS);
+              // Alarm advertising, counter and led
+              SimpleBLEBroadcaster_raiseAlarm();
 
               // Next state
 //              appStateNew = STATE_ADV_ALARM;
@@ -807,7 +2290,7 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
 
 #ifdef BEACON_KEYRINGUS
                 // Led off
-                PIN_setOutputValue(ledCtrlHandle, Board_LED1, Board_LED_OFF);
+                Board_ledStop();
 
                 // Next state
                 appStateNew = appState;
@@ -818,6 +2301,9 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
             // Clear flags
             keyTimeoutLong  = false;
             keyTimeoutShort = false;
+#ifdef MAINTENANCE_WINDOW
+            keyTimeoutMaint = false;
+#endif
         }
 
       break;
@@ -877,48 +2363,1121 @@ void SimpleBLEPeripheral_atuomateHandler(uint8_t key)
 
   // Update appState
   appState = appStateNew;
+
+#ifdef AUTOMATE_CHECKS
+  SimpleBLEBroadcaster_checkInvariants(key);
+#endif
 }
 
 
+#ifdef AUTOMATE_CHECKS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_checkInvariants
+ *
+ * @brief   Automate invariants, checked after every key event:
+ *          - advertising is never left disabled outside warehouse
+ *          - key timeout flags are cleared once the key is released
+ *
+ * @param   key - key state just handled
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_checkInvariants(uint8_t key)
+{
+    uint8_t advEnabled = FALSE;
+
+    GAPRole_GetParameter(GAPROLE_ADVERT_ENABLED, &advEnabled);
+
+#ifdef MAINTENANCE_WINDOW
+    // Advertising stops while the maintenance connection is up
+    if (!maintConnected)
+#endif
+    {
+        SBB_CHECK((appState == STATE_WAREHOUSE) || advEnabled || advStartPending);
+    }
+
+    SBB_CHECK((appState == STATE_WAREHOUSE) || (appState == STATE_ADV_NORMAL) ||
+              (appState == STATE_ADV_KEEPALIVE) || (appState == STATE_ADV_STILL));
+
+    if (!key)
+    {
+        SBB_CHECK(!keyTimeoutShort && !keyTimeoutLong);
+#ifdef MAINTENANCE_WINDOW
+        SBB_CHECK(!keyTimeoutMaint);
+#endif
+    }
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_checkFailed
+ *
+ * @brief   Record a failed invariant check (set a breakpoint here).
+ *
+ * @param   line - source line of the check
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_checkFailed(uint16_t line)
+{
+    sbbCheckFailLine = line;
+    sbbCheckFailCount++;
+
+    LOG_EVENT1(LOG_CHECK_FAILED, line);
+}
+#endif // AUTOMATE_CHECKS
+
+
 void setAdvIntData(uint8_t adv_mode)
 {
-    uint8_t initial_advertising_enable;
+    uint16_t advInt;
+
+    // Any mode change ends a running alarm burst and a delayed start
+    alarmBurstInterval = 0;
+    advStartPending = false;
+    Util_stopClock(&advStartTimer);
+
+#ifdef MAINTENANCE_WINDOW
+    // Any other mode closes the maintenance window
+    if (adv_mode != ADV_MAINTENANCE)
+    {
+        SimpleBLEBroadcaster_closeMaintWindow();
+    }
+#endif
+
+    // Set advertising interval
+    switch (adv_mode)
+    {
+      // Stop adverising
+      case ADV_STOP:
+      {
+          uint8_t initial_advertising_enable = FALSE;
+          GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                                           &initial_advertising_enable);
+      }
+#ifdef POWER_SAVING
+      // Only the warehouse stops advertising, shut down shortly
+      Util_restartClock(&shutdownTimer, SHUTDOWN_DELAY);
+#endif
+      return;
+
+      // Set advertising interval for default event
+      case ADV_DEFAULT:
+          advInt = advDithered(appConfig.advPeriod * 1600 * battTiers[battTier].intervalMult);
+          break;
+
+      // Set advertising interval for alarm event, starting with a burst
+      case ADV_ALARM:
+          // Status slot, whatever the rotation left in the GAP buffer.
+          // The very first alarm packet already carries the alarm bit
+          // and the time the alarm was raised
+          alarmTime = SimpleBLEBroadcaster_timeBase();
+          advertData[6] = 0x80 | ((battTier > 0)? 0x40 : 0) | batt;
+          advertData[7]++;
+          advertData[8] = LO_UINT16(alarmTime);
+          advertData[9] = HI_UINT16(alarmTime);
+          GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
+
+          alarmBurstInterval = ALARM_BURST_INTERVAL;
+          alarmBurstEvents   = 0;
+          alarmBurstTime     = 0;
+          advInt = ALARM_BURST_INTERVAL + advRand() % ALARM_BURST_JITTER;
+          alarmsRaised++;
+#ifdef AUTOMATE_CHECKS
+          alarmDrainEvents = 0;
+#endif
+          break;
+
+      // Set advertising interval for keepalive event
+      case ADV_KEEPALIVE:
+          advInt = advDithered(appConfig.keepalivePeriod * 1600 * battTiers[battTier].intervalMult);
+          break;
+
+      // Set advertising interval while the device is still
+      case ADV_STILL: advInt = advDithered(STILL_ADVERTISING_INTERVAL); break;
+
+#ifdef MAINTENANCE_WINDOW
+      // Set advertising interval for the connectable maintenance window
+      case ADV_MAINTENANCE: advInt = MAINT_ADVERTISING_INTERVAL; break;
+#endif
+
+      default: return;
+    }
+
+#ifdef MAINTENANCE_WINDOW
+    setAdvType((adv_mode == ADV_MAINTENANCE)? GAP_ADTYPE_ADV_IND : ADV_EVENT_TYPE);
+#endif
+
+    // Full TX power for alarms, controlled power otherwise
+    HCI_EXT_SetTxPowerCmd((adv_mode == ADV_ALARM)? HCI_EXT_TX_POWER_5_DBM :
+                          SimpleBLEBroadcaster_txPower());
+
+    // Started from stopped (power up, warehouse activation): wait a random
+    // part of the interval so that devices started together are out of
+    // phase, alarms always start at once
+    if ((adv_mode == ADV_DEFAULT) || (adv_mode == ADV_KEEPALIVE))
+    {
+        uint8_t advEnabled = FALSE;
+
+        GAPRole_GetParameter(GAPROLE_ADVERT_ENABLED, &advEnabled);
+        if (!advEnabled)
+        {
+            advStartInterval = advInt;
+            advStartPending  = true;
+            Util_restartClock(&advStartTimer, 1 + advRand() % ((uint32_t)advInt * 5 / 8));
+            return;
+        }
+    }
+
+    setAdvInterval(advInt);
+}
+
+
+#ifdef SBB_COMMANDS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_setState
+ *
+ * @brief   Remote state change (gateway command), same transitions and
+ *          advertising as the key driven automaton.
+ *
+ * @param   state - STATE_WAREHOUSE, STATE_ADV_NORMAL or STATE_ADV_KEEPALIVE
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_setState(uint8_t state)
+{
+    if ((state != STATE_WAREHOUSE) && (state != STATE_ADV_NORMAL) &&
+        (state != STATE_ADV_KEEPALIVE))
+    {
+        return;
+    }
+
+    // Never interrupt an alarm
+    if (state == appState || alarmCounter > 0 || alarmBurstInterval > 0)
+    {
+        return;
+    }
+
+    appState = state;
+    SimpleBLEBroadcaster_restoreAdv();
+}
+#endif // SBB_COMMANDS
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_ledPlay
+ *
+ * @brief   Play a led pattern. Does nothing when the led has been
+ *          disabled by configuration.
+ *
+ * @param   pattern - LED_PATTERN_xxx
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_ledPlay(uint8_t pattern)
+{
+    if (!appConfig.ledEnable)
+    {
+        return;
+    }
+
+    // Only the alarm feedback is kept in degraded battery tiers
+    if (!battTiers[battTier].ledEnable && (pattern != LED_PATTERN_ALARM))
+    {
+        return;
+    }
+
+    Board_ledPlay(pattern);
+}
+
+
+#ifdef BEACON_WRISTBAND
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_raiseAlarm
+ *
+ * @brief   Start the alarm advertising, from the key or a detected fall.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_raiseAlarm(void)
+{
+    // Set advertising data
+    setAdvIntData(ADV_ALARM);
+
+    // Set alarm counter
+    alarmCounter = EVENTOS_EN_UN_MINUTO;
+
+    LOG_EVENT1(LOG_ALARM, appState);
+
+    // Launch alarm led
+    SimpleBLEBroadcaster_ledPlay(LED_PATTERN_ALARM);
+}
+#endif
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_restoreAdv
+ *
+ * @brief   Restart the advertising that belongs to the current state,
+ *          e.g. after a configuration change or the maintenance window.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_restoreAdv(void)
+{
+    // A running alarm restores the default advertising when it drains
+    if (alarmCounter > 0 || alarmBurstInterval > 0)
+    {
+        return;
+    }
+
+#ifdef ACCEL_FALL_DETECT
+    // Normal advertising slows down while the device is still
+    if ((appState == STATE_ADV_NORMAL) || (appState == STATE_ADV_STILL))
+    {
+        appState = (!accelMoving && (appConfig.stillTime > 0))? STATE_ADV_STILL :
+                                                                 STATE_ADV_NORMAL;
+    }
+#endif
+
+    switch (appState)
+    {
+      case STATE_WAREHOUSE:     setAdvIntData(ADV_STOP);      break;
+      case STATE_ADV_KEEPALIVE: setAdvIntData(ADV_KEEPALIVE); break;
+      case STATE_ADV_STILL:     setAdvIntData(ADV_STILL);     break;
+      default:                  setAdvIntData(ADV_DEFAULT);   break;
+    }
+}
+
+
+#ifdef SBB_COMMANDS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_applyConfig
+ *
+ * @brief   Validate and apply a batch of configuration records
+ *          (id, length, value). Nothing is applied if any record is
+ *          malformed.
+ *
+ * @param   pBatch - configuration records
+ * @param   len    - batch length
+ *
+ * @return  true if the batch was applied
+ */
+static bool SimpleBLEBroadcaster_applyConfig(const uint8_t *pBatch, uint16_t len)
+{
+    sbbConfig_t config = appConfig;
+    const uint8_t *pName = NULL;
+    uint8_t nameLen = 0;
+    const uint8_t *pQuality = NULL;
+    uint16_t i;
+
+    // Validate the whole batch first
+    for (i = 0; i < len; i += 2 + pBatch[i + 1])
+    {
+        const uint8_t *pValue = &pBatch[i + 2];
+        uint8_t recLen;
+
+        if ((i + 2 > len) || (i + 2 + pBatch[i + 1] > len))
+        {
+            return false;
+        }
+
+        recLen = pBatch[i + 1];
+
+        switch (pBatch[i])
+        {
+          case CFG_ADV_PERIOD:
+          case CFG_KEEPALIVE_PERIOD:
+              if ((recLen != 1) || (pValue[0] < 1) || (pValue[0] > 10))
+              {
+                  return false;
+              }
+              if (pBatch[i] == CFG_ADV_PERIOD) config.advPeriod = pValue[0];
+              else                             config.keepalivePeriod = pValue[0];
+              break;
+
+          case CFG_SLOT_RATIO:
+              if ((recLen != 1) || (pValue[0] > 20))
+              {
+                  return false;
+              }
+              config.slotRatio = pValue[0];
+              break;
+
+          case CFG_RX_QUALITY:
+              if ((recLen != 1) || (pValue[0] > 100))
+              {
+                  return false;
+              }
+              pQuality = pValue;
+              break;
+
+          case CFG_STILL_TIME:
+              if (recLen != 2)
+              {
+                  return false;
+              }
+              config.stillTime = pValue[0] | ((uint16_t)pValue[1] << 8);
+              if ((config.stillTime != 0) &&
+                  ((config.stillTime < 10) || (config.stillTime > 1300)))
+              {
+                  return false;
+              }
+              break;
+
+          case CFG_LED_ENABLE:
+          case CFG_RELAY_ENABLE:
+              if ((recLen != 1) || (pValue[0] > 1))
+              {
+                  return false;
+              }
+              if (pBatch[i] == CFG_LED_ENABLE) config.ledEnable = pValue[0];
+              else                             config.relayEnable = pValue[0];
+              break;
+
+          case CFG_DEVICE_NAME:
+              if ((recLen == 0) || (recLen > SCAN_RSP_NAME_MAX_LEN))
+              {
+                  return false;
+              }
+              pName   = pValue;
+              nameLen = recLen;
+              break;
+
+          default:
+              return false;
+        }
+    }
+
+    // Apply
+    if (pName)
+    {
+        SimpleBLEBroadcaster_setDeviceName(pName, nameLen);
+    }
+
+    if (pQuality)
+    {
+        SimpleBLEBroadcaster_txFeedback(pQuality[0]);
+    }
+
+    if (memcmp(&config, &appConfig, sizeof(config)) != 0)
+    {
+        if (!config.ledEnable)
+        {
+            Board_ledStop();
+        }
+
+#ifdef ACCEL_FALL_DETECT
+        if (config.stillTime != appConfig.stillTime)
+        {
+            Board_accelSetStillTime(config.stillTime);
+        }
+#endif
+
+        appConfig = config;
+        osal_snv_write(SNV_ID_APPCONFIG, sizeof(appConfig), &appConfig);
+
+#ifdef MAINTENANCE_WINDOW
+        // New intervals are picked up when the maintenance window closes
+        if (!maintWindowOpen)
+#endif
+        {
+            SimpleBLEBroadcaster_restoreAdv();
+        }
+    }
+
+    return true;
+}
+#endif // SBB_COMMANDS
+
+
+#ifdef MAINTENANCE_WINDOW
+/*********************************************************************
+ * @fn      setAdvType
+ *
+ * @brief   Change the advertising event type, advertising must be
+ *          restarted afterwards.
+ *
+ * @param   advType - GAP_ADTYPE_ADV_IND or ADV_EVENT_TYPE
+ *
+ * @return  none
+ */
+static void setAdvType(uint8_t advType)
+{
+    uint8_t initial_advertising_enable = FALSE;
+
+    if (advType == advTypeActive)
+    {
+        return;
+    }
+
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                         &initial_advertising_enable);
+    GAPRole_SetParameter(GAPROLE_ADV_EVENT_TYPE, sizeof(uint8_t), &advType);
+
+    advTypeActive = advType;
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_openMaintWindow
+ *
+ * @brief   Open the connectable maintenance window for
+ *          MAINT_WINDOW_DURATION. Never opened from warehouse.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_openMaintWindow(void)
+{
+    if (maintWindowOpen || (appState == STATE_WAREHOUSE) ||
+        (alarmCounter > 0) || (alarmBurstInterval > 0))
+    {
+        return;
+    }
+
+    setAdvIntData(ADV_MAINTENANCE);
+    maintWindowOpen = true;
+
+    Util_restartClock(&maintWindowTimer, MAINT_WINDOW_DURATION);
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_closeMaintWindow
+ *
+ * @brief   Close the maintenance window, dropping the connection if
+ *          any. The caller restarts the advertising it needs.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_closeMaintWindow(void)
+{
+    if (!maintWindowOpen)
+    {
+        return;
+    }
+
+    maintWindowOpen = false;
+    Util_stopClock(&maintWindowTimer);
+
+    if (maintConnected)
+    {
+        GAPRole_TerminateConnection();
+    }
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateTelemetry
+ *
+ * @brief   Snapshot the telemetry served by the maintenance service.
+ *          Layout (little endian):
+ *            0     firmware version
+ *            1     application state
+ *            2-4   battery, battery min, battery max
+ *            5-6   alarms raised since power up
+ *            7-10  uptime in seconds
+ *            11-22 led on time per pattern (LED_PATTERN_xxx order),
+ *                  units of 100 ms, saturated at 0xFFFF
+ *            23    battery history samples (N)
+ *            24-   battery history, oldest first (N bytes)
+ *            24+N- wakeup report, POWER_MEASURE builds only (see
+ *                  SimpleBLEBroadcaster_pmReport)
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateTelemetry(void)
+{
+    uint8_t  *telemetry = maintBuffer;
+    uint32_t uptime = AONRTCSecGet();
+    uint16_t len;
+    uint8_t  i, idx;
+
+    telemetry[0]  = FIRMWARE_VERSION;
+    telemetry[1]  = appState;
+    telemetry[2]  = batt;
+    telemetry[3]  = battMin;
+    telemetry[4]  = battMax;
+    telemetry[5]  = LO_UINT16(alarmsRaised);
+    telemetry[6]  = HI_UINT16(alarmsRaised);
+    telemetry[7]  = BREAK_UINT32(uptime, 0);
+    telemetry[8]  = BREAK_UINT32(uptime, 1);
+    telemetry[9]  = BREAK_UINT32(uptime, 2);
+    telemetry[10] = BREAK_UINT32(uptime, 3);
+
+    for (i = 0; i < LED_PATTERN_COUNT; i++)
+    {
+        uint32_t onTime = MIN(ledOnTime[i] / 100, 0xFFFF);
+
+        telemetry[11 + 2*i] = LO_UINT16(onTime);
+        telemetry[12 + 2*i] = HI_UINT16(onTime);
+    }
+
+    telemetry[TELEMETRY_HDR_LEN - 1] = battHistoryCount;
+
+    idx = (battHistoryIdx + BATT_HISTORY_LEN - battHistoryCount) % BATT_HISTORY_LEN;
+    for (i = 0; i < battHistoryCount; i++)
+    {
+        telemetry[TELEMETRY_HDR_LEN + i] = battHistory[idx];
+        idx = (idx + 1) % BATT_HISTORY_LEN;
+    }
+    len = TELEMETRY_HDR_LEN + battHistoryCount;
+
+#ifdef POWER_MEASURE
+    len += SimpleBLEBroadcaster_pmReport(&telemetry[len]);
+#endif
+
+    MaintService_SetParameter(MAINT_TELEMETRY, len, telemetry);
+}
+
+
+#ifdef EVENT_LOG
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateLog
+ *
+ * @brief   Copy the oldest event log records to the maintenance
+ *          service. They stay in the ring until the value is read out.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateLog(void)
+{
+    uint16_t len = EventLog_peek(maintBuffer, MAINT_LOG_MAX_LEN);
+
+    MaintService_SetParameter(MAINT_LOG, len, maintBuffer);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_maintLogReadCB
+ *
+ * @brief   Callback from the maintenance service (stack context), the
+ *          event log value was read up to its last byte.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_maintLogReadCB(void)
+{
+    SimpleBLEBroadcaster_enqueueMsg(SBB_MAINT_LOG_READ_EVT, 0);
+}
+#endif
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_maintConfigChangeCB
+ *
+ * @brief   Callback from the maintenance service (stack context), the
+ *          batch is parsed in the application task.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_maintConfigChangeCB(void)
+{
+    SimpleBLEBroadcaster_enqueueMsg(SBB_MAINT_CONFIG_EVT, 0);
+}
+#endif // MAINTENANCE_WINDOW
+
+
+/*********************************************************************
+ * @fn      setAdvInterval
+ *
+ * @brief   Restart advertising with a new interval.
+ *
+ * @param   advInt - advertising interval (units of 625us)
+ *
+ * @return  none
+ */
+static void setAdvInterval(uint16_t advInt)
+{
+    uint8_t initial_advertising_enable;
+
+    // Stop the actual advertising data
+    initial_advertising_enable = FALSE;
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                                     &initial_advertising_enable);
+
+    // Write GAP parameter
+    advIntervalActive = advInt;
+    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MIN, advInt);
+    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MAX, advInt);
+    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MIN, advInt);
+    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MAX, advInt);
+
+    // Start advertising data
+    initial_advertising_enable = TRUE;
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                         &initial_advertising_enable);
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateScanRsp
+ *
+ * @brief   Compose the scan response (device name + metadata) and hand
+ *          it to the GAP role. Called only when its contents changed.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateScanRsp(void)
+{
+    uint8_t *p = scanRspData;
+
+    // complete name
+    *p++ = devName.len + 1;
+    *p++ = GAP_ADTYPE_LOCAL_NAME_COMPLETE;
+    memcpy(p, devName.name, devName.len);
+    p += devName.len;
+
+    // metadata: firmware version, serial number, battery min/max
+    *p++ = SCAN_RSP_META_LEN - 1;
+    *p++ = GAP_ADTYPE_MANUFACTURER_SPECIFIC;
+    *p++ = FRAME_METADATA;
+    *p++ = FIRMWARE_VERSION;
+    memcpy(p, devSerial, sizeof(devSerial));
+    p += sizeof(devSerial);
+    *p++ = battMin;
+    *p++ = battMax;
+
+    GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, p - scanRspData, scanRspData);
+
+    scanRspDirty = false;
+}
+
+
+#ifdef SBB_COMMANDS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_setDeviceName
+ *
+ * @brief   Change the device name served in the scan response. The name
+ *          is kept in SNV and survives resets.
+ *
+ * @param   pName - new name (not null terminated)
+ * @param   len   - name length, 1 to SCAN_RSP_NAME_MAX_LEN
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_setDeviceName(const uint8_t *pName, uint8_t len)
+{
+    if ((len == 0) || (len > SCAN_RSP_NAME_MAX_LEN))
+    {
+        return;
+    }
+
+    if ((len == devName.len) && (memcmp(pName, devName.name, len) == 0))
+    {
+        return;
+    }
+
+    devName.len = len;
+    memcpy(devName.name, pName, len);
+    osal_snv_write(SNV_ID_DEVNAME, sizeof(devName), &devName);
+
+#ifdef MAINTENANCE_WINDOW
+    {
+        uint8_t attDeviceName[GAP_DEVICE_NAME_LEN] = { 0 };
+
+        memcpy(attDeviceName, devName.name, devName.len);
+        GGS_SetParameter(GGS_DEVICE_NAME_ATT, GAP_DEVICE_NAME_LEN, attDeviceName);
+    }
+#endif
+
+    scanRspDirty = true;
+}
+#endif // SBB_COMMANDS
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_nextAdvSlot
+ *
+ * @brief   Advertising slot for the next event: appConfig.slotRatio
+ *          status events, then one extra slot in turn. Only status is
+ *          advertised during an alarm, a relayed alarm takes every
+ *          other event.
+ *
+ * @param   none
+ *
+ * @return  ADV_SLOT_xxx
+ */
+static uint8_t SimpleBLEBroadcaster_nextAdvSlot(void)
+{
+    if ((alarmCounter > 0) || (alarmBurstInterval > 0))
+    {
+        advSlotCount = 0;
+        return ADV_SLOT_STATUS;
+    }
 
-    // Stop the actual advertising data
-    initial_advertising_enable = FALSE;
-    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
-                                     &initial_advertising_enable);
+#ifdef ALARM_RELAY
+    if (relayEvents > 0)
+    {
+        if (--relayEvents & 0x01)
+        {
+            return ADV_SLOT_RELAY;
+        }
+        return ADV_SLOT_STATUS;
+    }
+#endif
 
-    // Stop adverising
-    if (adv_mode == ADV_STOP) return;
+    if (appConfig.slotRatio == 0)
+    {
+        advSlotCount = 0;
+        return ADV_SLOT_STATUS;
+    }
 
-    uint16_t advInt;
-    // Set advertising interval
-    switch (adv_mode)
+    if (++advSlotCount <= appConfig.slotRatio)
     {
-      // Set advertising interval for alarm event
-      case ADV_DEFAULT:   advInt = DEFAULT_ADVERTISING_INTERVAL;  break;
+        return ADV_SLOT_STATUS;
+    }
+
+    advSlotCount = 0;
+    advSlotExtra = (advSlotExtra + 1) % sizeof(advSlotExtras);
+
+    return advSlotExtras[advSlotExtra];
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateTelemetrySlot
+ *
+ * @brief   Compose the telemetry advertising slot.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateTelemetrySlot(void)
+{
+    uint16_t uptime = (uint16_t)(AONRTCSecGet() / 3600);
+
+    advTelemetry[6]  = appState;
+    advTelemetry[7]  = batt;
+    advTelemetry[8]  = battMin;
+    advTelemetry[9]  = LO_UINT16(alarmsRaised);
+    advTelemetry[10] = HI_UINT16(alarmsRaised);
+    advTelemetry[11] = LO_UINT16(uptime);
+    advTelemetry[12] = HI_UINT16(uptime);
+    advTelemetry[13] = battTier;
+#ifdef ACCEL_FALL_DETECT
+    advTelemetry[14] = LO_UINT16(activity.steps);
+    advTelemetry[15] = HI_UINT16(activity.steps);
+    advTelemetry[16] = LO_UINT16(activity.activeMinutes);
+    advTelemetry[17] = HI_UINT16(activity.activeMinutes);
+#endif
 
-      // Set advertising interval for alarm event
-      case ADV_ALARM:     advInt = ALARM_ADVERTISING_INTERVAL;    break;
+    advTelemetryDirty = false;
+}
 
-      // Set advertising interval for alarm event
-      case ADV_KEEPALIVE: advInt = LONG_ADVERTISING_INTERVAL;     break;
 
-      default: break;
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateTlmSlot
+ *
+ * @brief   Refresh the Eddystone-TLM slot (unencrypted TLM, version 0).
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateTlmSlot(void)
+{
+    // Seconds and fraction from one consistent read, two separate reads
+    // can straddle a second rollover
+    uint64_t rtc    = AONRTCCurrent64BitValueGet();
+    uint32_t uptime = (uint32_t)(rtc >> 32) * 10 +
+                      (((((uint32_t)rtc) >> 16) * 10) >> 16);
+
+    // No measure yet, battery voltage and temperature not supported
+    if (battMv != 0)
+    {
+        advTlm[13] = HI_UINT16(battMv);
+        advTlm[14] = LO_UINT16(battMv);
+        advTlm[15] = (uint8_t)battTemp;
+        advTlm[16] = 0;
     }
 
-    // Write GAP parameter
-    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MIN, advInt);
-    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MAX, advInt);
-    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MIN, advInt);
-    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MAX, advInt);
+    advTlm[17] = BREAK_UINT32(advCount, 3);
+    advTlm[18] = BREAK_UINT32(advCount, 2);
+    advTlm[19] = BREAK_UINT32(advCount, 1);
+    advTlm[20] = BREAK_UINT32(advCount, 0);
+    advTlm[21] = BREAK_UINT32(uptime, 3);
+    advTlm[22] = BREAK_UINT32(uptime, 2);
+    advTlm[23] = BREAK_UINT32(uptime, 1);
+    advTlm[24] = BREAK_UINT32(uptime, 0);
+}
 
-    // Start advertising data
-    initial_advertising_enable = TRUE;
-    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
-                         &initial_advertising_enable);
 
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_updateBattTier
+ *
+ * @brief   Move along the degradation ladder after a battery measure,
+ *          with hysteresis so a recovering (warmer, unloaded) battery
+ *          does not toggle tiers. New tier settings are applied right
+ *          away, except during an alarm or the maintenance window.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_updateBattTier(void)
+{
+    uint8_t tier = battTier;
+
+    if (battMv == 0)
+    {
+        return;
+    }
+
+    while ((tier + 1 < sizeof(battTiers)/sizeof(battTiers[0])) &&
+           (battMv < battTiers[tier + 1].enterMv))
+    {
+        tier++;
+    }
+
+    while ((tier > 0) &&
+           (battMv >= battTiers[tier].enterMv + BATT_TIER_HYSTERESIS_MV))
+    {
+        tier--;
+    }
+
+    if (tier == battTier)
+    {
+        return;
+    }
+
+    battTier = tier;
+    SimpleBLEBroadcaster_applyTxPower();
+
+#ifdef MAINTENANCE_WINDOW
+    if (!maintWindowOpen)
+#endif
+    {
+        SimpleBLEBroadcaster_restoreAdv();
+    }
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_txPower
+ *
+ * @brief   TX power outside alarms: battery tier power less the steps
+ *          taken down by the reception feedback.
+ *
+ * @param   none
+ *
+ * @return  HCI_EXT_TX_POWER_xxx
+ */
+static uint8_t SimpleBLEBroadcaster_txPower(void)
+{
+    uint8_t txPower = battTiers[battTier].txPower;
+
+    // HCI_EXT_TX_POWER_xxx are consecutive from HCI_EXT_TX_POWER_MINUS_21_DBM
+    if (txPower - HCI_EXT_TX_POWER_MINUS_21_DBM > txPowerReduction)
+    {
+        return txPower - txPowerReduction;
+    }
+
+    return HCI_EXT_TX_POWER_MINUS_21_DBM;
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_applyTxPower
+ *
+ * @brief   Apply a TX power change: the iBeacon measured power always,
+ *          the radio unless an alarm holds it at full power.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_applyTxPower(void)
+{
+    uint8_t txPower = SimpleBLEBroadcaster_txPower();
+
+    advIBeacon[29] = (uint8_t)(IBEACON_RSSI_0DBM + txPowerDbm[txPower]);
+
+    if ((alarmCounter == 0) && (alarmBurstInterval == 0))
+    {
+        HCI_EXT_SetTxPowerCmd(txPower);
+    }
+}
+
+
+#ifdef SBB_COMMANDS
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_txFeedback
+ *
+ * @brief   Reception feedback from the gateways: one step down while
+ *          reception is good, TX_STEP_UP steps up when it is poor.
+ *
+ * @param   quality - delivery ratio seen by the gateways (%)
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_txFeedback(uint8_t quality)
+{
+    txFeedbackAge = 0;
+
+    if (quality >= TX_QUALITY_GOOD)
+    {
+        if (SimpleBLEBroadcaster_txPower() > HCI_EXT_TX_POWER_MINUS_21_DBM)
+        {
+            txPowerReduction++;
+        }
+    }
+    else if (quality < TX_QUALITY_POOR)
+    {
+        txPowerReduction = (txPowerReduction > TX_STEP_UP)?
+                           txPowerReduction - TX_STEP_UP : 0;
+    }
+
+    SimpleBLEBroadcaster_applyTxPower();
+}
+#endif // SBB_COMMANDS
+
+
+#ifdef POWER_MEASURE
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_pmWakeup
+ *
+ * @brief   Count a wakeup and log it in the trace. Called from clock
+ *          handlers too, a lost record under contention is acceptable.
+ *
+ * @param   src - PM_SRC_xxx
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_pmWakeup(uint8_t src)
+{
+    pmWakeups[src]++;
+
+    pmTrace[pmTraceIdx] = ((uint32_t)src << 28) | (Clock_getTicks() & 0x0FFFFFFF);
+    pmTraceIdx = (pmTraceIdx + 1) % PM_TRACE_LEN;
+}
+
+
+#ifdef MAINTENANCE_WINDOW
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_pmReport
+ *
+ * @brief   Wakeup report served in the maintenance telemetry (the board
+ *          display is compiled out). Layout, uint32 little endian:
+ *            0-    wakeups per source (PM_SRC_xxx order)
+ *            +0    led step clock wakeups
+ *            +4    application task active time in ms, the rest of the
+ *                  uptime is idle or standby
+ *            +8    dispatcher wakes with work
+ *            +12   dispatcher messages handled
+ *            +16   largest batch of messages in one wake
+ *            +20   worst alarm (key, fall) message queue residency in us
+ *            +24   worst other app message queue residency in us
+ *
+ * @param   pBuf - destination, TELEMETRY_PM_LEN bytes
+ *
+ * @return  bytes written
+ */
+static uint8_t SimpleBLEBroadcaster_pmReport(uint8_t *pBuf)
+{
+    uint32_t values[TELEMETRY_PM_LEN / 4];
+    uint8_t  n = 0;
+    uint8_t  len = 0;
+    uint8_t  i;
+
+    for (i = 0; i < PM_SRC_COUNT; i++)
+    {
+        values[n++] = pmWakeups[i];
+    }
+    values[n++] = Board_ledWakeups();
+    values[n++] = pmActiveTicks / (1000 / Clock_tickPeriod);
+    values[n++] = pmDispatchWakes;
+    values[n++] = pmDispatchMsgs;
+    values[n++] = pmBatchMax;
+    values[n++] = pmAlarmLatencyMax * Clock_tickPeriod;
+    values[n++] = pmAppLatencyMax * Clock_tickPeriod;
+
+    for (i = 0; i < n; i++)
+    {
+        pBuf[len++] = BREAK_UINT32(values[i], 0);
+        pBuf[len++] = BREAK_UINT32(values[i], 1);
+        pBuf[len++] = BREAK_UINT32(values[i], 2);
+        pBuf[len++] = BREAK_UINT32(values[i], 3);
+    }
+
+    return len;
+}
+#endif // MAINTENANCE_WINDOW
+#endif // POWER_MEASURE
+
+
+/*********************************************************************
+ * @fn      advRand
+ *
+ * @brief   Cheap xorshift32 pseudo random number, used to dither the
+ *          advertising intervals.
+ *
+ * @param   none
+ *
+ * @return  16 bit pseudo random number
+ */
+static uint16_t advRand(void)
+{
+    advRandState ^= advRandState << 13;
+    advRandState ^= advRandState >> 17;
+    advRandState ^= advRandState << 5;
+
+    return (uint16_t)advRandState;
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_timeBase
+ *
+ * @brief   Coarse time base advertised in the status frame. AON RTC
+ *          since power up, clocked by SCLK_LF and so kept calibrated by
+ *          rcosc_calibration when USE_RCOSC is enabled. Gateways track
+ *          the drift of every device against their own clock.
+ *
+ * @param   none
+ *
+ * @return  time in 1/8 s (wraps every 8192 s)
+ */
+static uint16_t SimpleBLEBroadcaster_timeBase(void)
+{
+    // 16.16 seconds read in one go, no carry race between the fields
+    return (uint16_t)(AONRTCCurrentCompareValueGet() >> 13);
+}
+
+
+/*********************************************************************
+ * @fn      advDithered
+ *
+ * @brief   Apply the per device offset to an advertising interval, so
+ *          that devices with the same configuration drift apart.
+ *
+ * @param   advInt - nominal interval (units of 625us)
+ *
+ * @return  interval to use, within 32-16384
+ */
+static uint16_t advDithered(uint32_t advInt)
+{
+    advInt = MIN(advInt, 16384);
+
+    return (advInt + advDither > 16384)? advInt - advDither : advInt + advDither;
 }
 
 
@@ -937,12 +3496,108 @@ static void SimpleBLEBroadcaster_processAppMsg(sbbEvt_t *pMsg)
 {
   switch (pMsg->hdr.event)
   {
+    case SBB_ADV_START_EVT:
+      // Delayed advertising start, unless another mode took over
+      if (advStartPending)
+      {
+        advStartPending = false;
+        setAdvInterval(advStartInterval);
+      }
+      break;
+
     case SBB_STATE_CHANGE_EVT:
       SimpleBLEBroadcaster_processStateChangeEvt((gaprole_States_t)pMsg->
                                                  hdr.state);
       break;
 
+#ifdef MAINTENANCE_WINDOW
+    case SBB_MAINT_OPEN_EVT:
+      SimpleBLEBroadcaster_openMaintWindow();
+      break;
+
+    case SBB_MAINT_CLOSE_EVT:
+      if (maintWindowOpen)
+      {
+        SimpleBLEBroadcaster_closeMaintWindow();
+        SimpleBLEBroadcaster_restoreAdv();
+      }
+      break;
+
+    case SBB_MAINT_CONFIG_EVT:
+      {
+        uint16_t len = 0;
+        UInt     key;
+
+        // Take the batch and consume it with the stack task held off, a
+        // write arriving after this is kept and notified again
+        key = Task_disable();
+        MaintService_GetParameter(MAINT_CONFIG, maintBuffer, &len);
+        MaintService_SetParameter(MAINT_CONFIG, 0, maintBuffer);
+        Task_restore(key);
+
+        // Same signed frame as a command beacon (CMD_CONFIG batch or
+        // CMD_STATE), anything else is dropped
+        if (len > 0)
+        {
+          SimpleBLEBroadcaster_processCommand(maintBuffer, len);
+        }
+      }
+      break;
+
+#ifdef EVENT_LOG
+    case SBB_MAINT_LOG_READ_EVT:
+      // Confirmed: drop the records read and serve the next ones
+      EventLog_ack();
+      SimpleBLEBroadcaster_updateLog();
+      break;
+#endif
+#endif
+
+#ifdef ACCEL_FALL_DETECT
+    case SBB_ACCEL_EVT:
+      SimpleBLEBroadcaster_processAccel();
+      break;
+
+    case SBB_MOTION_EVT:
+      SimpleBLEBroadcaster_processMotion(pMsg->hdr.state);
+      break;
+#endif
+
+#ifdef POWER_SAVING
+    case SBB_SHUTDOWN_EVT:
+      // Still in warehouse: every clock stops, KEY_1 resets the device
+      // which starts again in STATE_ADV_NORMAL
+      if (appState == STATE_WAREHOUSE)
+      {
+        int_fast16_t status;
+
+        Board_ledStop();
+#ifdef ACCEL_FALL_DETECT
+        Board_accelStandby();
+#endif
+        status = Board_keyShutdown();
+
+        // Refused (only returns then): log it and try again later rather
+        // than idle in warehouse with the radio off
+        LOG_EVENT1(LOG_SHUTDOWN_FAILED, -status);
+        (void)status;
+        Util_restartClock(&shutdownTimer, SHUTDOWN_DELAY);
+      }
+      break;
+#endif
+
     case SBB_KEY_CHANGE_EVT:
+#ifdef POWER_SAVING
+        // The press that woke the device from shutdown is not a key action
+        if (keyWakeHeld)
+        {
+            keyWakeHeld = false;
+            if (!pMsg->hdr.state)
+            {
+                break;
+            }
+        }
+#endif
         SimpleBLEPeripheral_atuomateHandler(pMsg->hdr.state);
 
 /*
@@ -1035,17 +3690,38 @@ static void SimpleBLEBroadcaster_processAppMsg(sbbEvt_t *pMsg)
  * @return  none
  */
 static void SimpleBLEBroadcaster_stateChangeCB(gaprole_States_t newState)
+{
+  SimpleBLEBroadcaster_enqueueMsg(SBB_STATE_CHANGE_EVT, newState);
+}
+
+
+/*********************************************************************
+ * @fn      SimpleBLEBroadcaster_enqueueMsg
+ *
+ * @brief   Creates a message and puts the message in RTOS queue.
+ *
+ * @param   event - message event.
+ * @param   state - message state.
+ *
+ * @return  none
+ */
+static void SimpleBLEBroadcaster_enqueueMsg(uint8_t event, uint8_t state)
 {
   sbbEvt_t *pMsg;
 
   // Create dynamic pointer to message.
   if ((pMsg = ICall_malloc(sizeof(sbbEvt_t))))
   {
-    pMsg->hdr.event = SBB_STATE_CHANGE_EVT;
-    pMsg->hdr.state = newState;
+    pMsg->hdr.event = event;
+    pMsg->hdr.state = state;
+#ifdef POWER_MEASURE
+    pMsg->ticks = Clock_getTicks();
+#endif
 
-    // Enqueue the message.
-    Util_enqueueMsg(appMsgQueue, sem, (uint8*)pMsg);
+    // Enqueue the message, the events that can raise an alarm on the
+    // priority queue.
+    Util_enqueueMsg(((event == SBB_KEY_CHANGE_EVT) || (event == SBB_ACCEL_EVT))?
+                    alarmMsgQueue : appMsgQueue, sem, (uint8*)pMsg);
   }
 }
 
@@ -1061,6 +3737,20 @@ static void SimpleBLEBroadcaster_stateChangeCB(gaprole_States_t newState)
  */
 static void SimpleBLEBroadcaster_processStateChangeEvt(gaprole_States_t newState)
 {
+#ifdef MAINTENANCE_WINDOW
+  // Connection dropped, by the central or on window timeout
+  if (maintConnected && (newState != GAPROLE_CONNECTED))
+  {
+    maintConnected = false;
+
+    if (maintWindowOpen)
+    {
+      SimpleBLEBroadcaster_closeMaintWindow();
+      SimpleBLEBroadcaster_restoreAdv();
+    }
+  }
+#endif
+
   switch (newState)
   {
     case GAPROLE_STARTED:
@@ -1069,35 +3759,69 @@ static void SimpleBLEBroadcaster_processStateChangeEvt(gaprole_States_t newState
 
         GAPRole_GetParameter(GAPROLE_BD_ADDR, ownAddress);
 
-        // Display device address
-        Display_print0(dispHandle, 1, 0, Util_convertBdAddr2Str(ownAddress));
-        Display_print0(dispHandle, 2, 0, "Initialized");
+        // First battery measure, before the first advertising event instead
+        // of one BATTERY_PERIOD later
+        SimpleBLEBroadcaster_measureBattery();
+
+        // Default serial number: low bytes of the device address
+        if ((devSerial[0] | devSerial[1] | devSerial[2] | devSerial[3]) == 0)
+        {
+          memcpy(devSerial, ownAddress, sizeof(devSerial));
+          scanRspDirty = true;
+        }
+
+        // iBeacon major/minor: serial number, big endian
+        advIBeacon[25] = devSerial[3];
+        advIBeacon[26] = devSerial[2];
+        advIBeacon[27] = devSerial[1];
+        advIBeacon[28] = devSerial[0];
+
+        LOG_EVENT2(LOG_INITIALIZED, BUILD_UINT16(ownAddress[4], ownAddress[5]),
+                   BUILD_UINT32(ownAddress[0], ownAddress[1], ownAddress[2], ownAddress[3]));
       }
       break;
 
     case GAPROLE_ADVERTISING:
       {
-        Display_print0(dispHandle, 2, 0, "Advertising");
+        LOG_EVENT0(LOG_ADVERTISING);
       }
       break;
 
     case GAPROLE_WAITING:
       {
-        Display_print0(dispHandle, 2, 0, "Waiting");
+        LOG_EVENT0(LOG_WAITING);
       }
       break;
 
-    case GAPROLE_ERROR:
+#ifdef MAINTENANCE_WINDOW
+    case GAPROLE_CONNECTED:
       {
-        Display_print0(dispHandle, 2, 0, "Error");
+        maintConnected = true;
+
+        // Fresh telemetry and a full window for this session
+        SimpleBLEBroadcaster_updateTelemetry();
+#ifdef EVENT_LOG
+        SimpleBLEBroadcaster_updateLog();
+#endif
+        Util_restartClock(&maintWindowTimer, MAINT_WINDOW_DURATION);
+
+        // Shortest connection interval to finish in few connection events
+        GAPRole_SendUpdateParam(MAINT_CONN_INTERVAL_MIN, MAINT_CONN_INTERVAL_MAX,
+                                0, MAINT_CONN_TIMEOUT, GAPROLE_NO_ACTION);
+
+        LOG_EVENT0(LOG_CONNECTED);
       }
       break;
+#endif
 
-    default:
+    case GAPROLE_ERROR:
       {
-        Display_clearLine(dispHandle, 2);
+        LOG_EVENT0(LOG_GAP_ERROR);
       }
       break;
+
+    default:
+      break;
   }
 }
 
@@ -0,0 +1,104 @@
+/******************************************************************************
+
+ @file  siphash.c
+
+ @brief SipHash-2-4 keyed hash (Aumasson & Bernstein), used to
+        authenticate the command advertisements sent by the smartcare
+        gateways. Small and constant time, no hardware needed.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "siphash.h"
+
+/*********************************************************************
+ * MACROS
+ */
+#define ROTL64(x, b)  (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                  \
+  do {                                                            \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                      \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                      \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+  } while (0)
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static uint64_t SipHash_load64(const uint8_t *p, uint8_t len)
+{
+  uint64_t v = 0;
+
+  while (len--)
+  {
+    v |= ((uint64_t)p[len]) << (8 * len);
+  }
+
+  return v;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      SipHash_24
+ *
+ * @brief   SipHash-2-4 of a message.
+ *
+ * @param   key  - 128 bit key
+ * @param   pMsg - message
+ * @param   len  - message length
+ *
+ * @return  64 bit hash
+ */
+uint64_t SipHash_24(const uint8_t key[SIPHASH_KEY_LEN], const uint8_t *pMsg,
+                    uint16_t len)
+{
+  uint64_t k0 = SipHash_load64(key, 8);
+  uint64_t k1 = SipHash_load64(key + 8, 8);
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+  uint64_t m;
+  uint16_t left = len;
+
+  // Full 8 byte words
+  while (left >= 8)
+  {
+    m = SipHash_load64(pMsg, 8);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    pMsg += 8;
+    left -= 8;
+  }
+
+  // Last word, length in the top byte
+  m = SipHash_load64(pMsg, left) | ((uint64_t)(len & 0xFF) << 56);
+  v3 ^= m;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= m;
+
+  // Finalization
+  v2 ^= 0xFF;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/*********************************************************************
+*********************************************************************/
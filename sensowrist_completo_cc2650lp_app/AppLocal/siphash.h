@@ -0,0 +1,54 @@
+/******************************************************************************
+
+ @file  siphash.h
+
+ @brief SipHash-2-4 keyed hash, used to authenticate the command
+        advertisements sent by the smartcare gateways.
+
+ Target Device: CC2650, CC2640
+
+ *****************************************************************************/
+
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+
+/*********************************************************************
+ * CONSTANTS
+ */
+#define SIPHASH_KEY_LEN    16
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      SipHash_24
+ *
+ * @brief   SipHash-2-4 of a message.
+ *
+ * @param   key  - 128 bit key
+ * @param   pMsg - message
+ * @param   len  - message length
+ *
+ * @return  64 bit hash
+ */
+uint64_t SipHash_24(const uint8_t key[SIPHASH_KEY_LEN], const uint8_t *pMsg,
+                    uint16_t len);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIPHASH_H */